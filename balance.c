@@ -0,0 +1,388 @@
+/**
+ * @file balance.c
+ * @brief Implements balancing of chemical reactions.
+ * @author agent
+ * @since 18/10/2026
+ * This source file includes implementations for splitting a reaction into species,
+ * building its element-by-species matrix and solving it with exact rational arithmetic.
+ */
+
+#include <ctype.h>
+#include <string.h>
+#include "balance.h"
+#include "parser.h"
+#include "data.h"
+
+/**
+ * @brief Returns the greatest common divisor of two integers.
+ *
+ * @param a  First integer.
+ * @param b  Second integer.
+ *
+ * @return The non-negative greatest common divisor (0 if both are 0).
+ */
+static long long gcd(long long a, long long b) {
+    if (a < 0) {
+        a = -a;
+    }
+    if (b < 0) {
+        b = -b;
+    }
+    while (b != 0) {
+        long long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/**
+ * @brief Builds a fraction in lowest terms with a positive denominator.
+ *
+ * @param num  Numerator.
+ * @param den  Denominator (non-zero).
+ * @param r    Receives the fraction.
+ */
+static void ratMake(long long num, long long den, Rational *r) {
+    long long g = gcd(num, den);
+    if (g == 0) {
+        g = 1;
+    }
+    if (den < 0) {
+        num = -num;
+        den = -den;
+    }
+    r->num = num / g;
+    r->den = den / g;
+}
+
+/**
+ * @brief Multiplies two fractions.
+ *
+ * @param a  First fraction.
+ * @param b  Second fraction.
+ * @param r  Receives a * b.
+ *
+ * @return 0 on success, or 1 on overflow.
+ */
+static int ratMul(Rational a, Rational b, Rational *r) {
+    long long g1 = gcd(a.num, b.den);
+    long long g2 = gcd(b.num, a.den);
+    long long num, den;
+    if (g1 == 0) {
+        g1 = 1;
+    }
+    if (g2 == 0) {
+        g2 = 1;
+    }
+    if (__builtin_mul_overflow(a.num / g1, b.num / g2, &num) || __builtin_mul_overflow(a.den / g2, b.den / g1, &den)) {
+        return 1;
+    }
+    ratMake(num, den, r);
+    return 0;
+}
+
+/**
+ * @brief Subtracts two fractions.
+ *
+ * @param a  First fraction.
+ * @param b  Second fraction.
+ * @param r  Receives a - b.
+ *
+ * @return 0 on success, or 1 on overflow.
+ */
+static int ratSub(Rational a, Rational b, Rational *r) {
+    long long g = gcd(a.den, b.den);
+    long long x, y, num, den;
+    if (__builtin_mul_overflow(a.num, b.den / g, &x) || __builtin_mul_overflow(b.num, a.den / g, &y)
+        || __builtin_sub_overflow(x, y, &num) || __builtin_mul_overflow(a.den / g, b.den, &den)) {
+        return 1;
+    }
+    ratMake(num, den, r);
+    return 0;
+}
+
+/**
+ * @brief Allocates balancing scratch memory for an element table.
+ *
+ * @param strcapacity  Number of elements in the element table.
+ *
+ * @return The scratch, or NULL on allocation failure.
+ */
+BalanceScratch *newBalanceScratch(int strcapacity) {
+    BalanceScratch *scratch = (BalanceScratch *)malloc(sizeof(BalanceScratch));
+    if (scratch == NULL) {
+        return NULL;
+    }
+    scratch->strcapacity = strcapacity;
+    scratch->counts = (int *)malloc(strcapacity * sizeof(int));
+    scratch->rowOf = (int *)malloc(strcapacity * sizeof(int));
+    if (scratch->counts == NULL || scratch->rowOf == NULL) {
+        freeBalanceScratch(scratch);
+        return NULL;
+    }
+    for (int j = 0; j < strcapacity; j++) {
+        scratch->rowOf[j] = -1;
+    }
+    return scratch;
+}
+
+/**
+ * @brief Frees balancing scratch memory.
+ *
+ * @param scratch  The scratch to free (may be NULL).
+ */
+void freeBalanceScratch(BalanceScratch *scratch) {
+    if (scratch == NULL) {
+        return;
+    }
+    free(scratch->counts);
+    free(scratch->rowOf);
+    free(scratch);
+}
+
+/**
+ * @brief Splits one side of a reaction into species separated by '+'.
+ *
+ * @param text     Start of the side.
+ * @param end      One past the end of the side.
+ * @param scratch  Receives the species.
+ * @param nSpecies Pointer to the number of species found so far.
+ *
+ * @return 0 on success, or 1 on an empty species or too many species.
+ */
+static int splitSpecies(const char *text, const char *end, BalanceScratch *scratch, int *nSpecies) {
+    while (text <= end) {
+        const char *plus = text;
+        while (plus < end && *plus != '+') {
+            plus++;
+        }
+        const char *first = text;
+        const char *last = plus;
+        while (first < last && isspace((unsigned char)*first)) {
+            first++;
+        }
+        while (last > first && isspace((unsigned char)last[-1])) {
+            last--;
+        }
+        if (first == last || *nSpecies == BALANCE_MAX_SPECIES) {
+            return 1;
+        }
+        scratch->species[*nSpecies] = first;
+        scratch->speciesLen[*nSpecies] = last - first;
+        (*nSpecies)++;
+        text = plus + 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Builds the element-by-species matrix, with products counted negatively.
+ *
+ * @param strArr     Array of element names.
+ * @param scratch    Holds the species; receives the matrix.
+ * @param nSpecies   Number of species.
+ * @param nReactants Number of species left of the arrow.
+ * @param nRows      Receives the number of matrix rows (distinct elements).
+ *
+ * @return 0 on success, or 1 on an unparsable species or too many elements.
+ */
+static int buildMatrix(char **strArr, BalanceScratch *scratch, int nSpecies, int nReactants, int *nRows) {
+    int rows = 0;
+    int failed = 0;
+    for (int s = 0; s < nSpecies && !failed; s++) {
+        memset(scratch->counts, 0, scratch->strcapacity * sizeof(int));
+        if (countElements(scratch->species[s], scratch->speciesLen[s], strArr, scratch->strcapacity, scratch->counts) != 0) {
+            failed = 1;
+            break;
+        }
+        for (int j = 0; j < scratch->strcapacity; j++) {
+            if (scratch->counts[j] == 0) {
+                continue;
+            }
+            int row = scratch->rowOf[j];
+            if (row < 0) {
+                if (rows == BALANCE_MAX_ELEMENTS) {
+                    failed = 1;
+                    break;
+                }
+                row = rows++;
+                scratch->rowOf[j] = row;
+                scratch->rowElement[row] = j;
+                for (int c = 0; c < nSpecies; c++) {
+                    scratch->matrix[row][c].num = 0;
+                    scratch->matrix[row][c].den = 1;
+                }
+            }
+            scratch->matrix[row][s].num = s < nReactants ? scratch->counts[j] : -scratch->counts[j];
+        }
+    }
+
+    // Leave rowOf clean for the next reaction
+    for (int r = 0; r < rows; r++) {
+        scratch->rowOf[scratch->rowElement[r]] = -1;
+    }
+    *nRows = rows;
+    return failed;
+}
+
+/**
+ * @brief Solves the matrix for the smallest positive integer coefficients.
+ *
+ * @param scratch   Holds the matrix; receives the coefficients.
+ * @param nRows     Number of matrix rows.
+ * @param nSpecies  Number of species (matrix columns).
+ *
+ * @return NULL on success, or the error message to report.
+ */
+static const char *solveMatrix(BalanceScratch *scratch, int nRows, int nSpecies) {
+    Rational (*m)[BALANCE_MAX_SPECIES] = scratch->matrix;
+    int isPivot[BALANCE_MAX_SPECIES] = {0};
+    int pivotCol[BALANCE_MAX_ELEMENTS];
+    int rank = 0;
+
+    // Reduce to reduced row echelon form
+    for (int col = 0; col < nSpecies && rank < nRows; col++) {
+        int r = rank;
+        while (r < nRows && m[r][col].num == 0) {
+            r++;
+        }
+        if (r == nRows) {
+            continue;
+        }
+        for (int c = 0; c < nSpecies; c++) {
+            Rational t = m[r][c];
+            m[r][c] = m[rank][c];
+            m[rank][c] = t;
+        }
+        Rational inverse;
+        ratMake(m[rank][col].den, m[rank][col].num, &inverse);
+        for (int c = 0; c < nSpecies; c++) {
+            if (m[rank][c].num != 0 && ratMul(m[rank][c], inverse, &m[rank][c]) != 0) {
+                return "Error: coefficients overflow";
+            }
+        }
+        for (int r2 = 0; r2 < nRows; r2++) {
+            if (r2 == rank || m[r2][col].num == 0) {
+                continue;
+            }
+            Rational factor = m[r2][col];
+            for (int c = 0; c < nSpecies; c++) {
+                Rational t;
+                if (m[rank][c].num == 0) {
+                    continue;
+                }
+                if (ratMul(factor, m[rank][c], &t) != 0 || ratSub(m[r2][c], t, &m[r2][c]) != 0) {
+                    return "Error: coefficients overflow";
+                }
+            }
+        }
+        isPivot[col] = 1;
+        pivotCol[rank++] = col;
+    }
+
+    if (nSpecies - rank == 0) {
+        return "Error: reaction is inconsistent";
+    }
+    if (nSpecies - rank > 1) {
+        return "Error: reaction is underdetermined";
+    }
+
+    // One free species: set it to 1 and scale the solution to integers
+    int freeCol = 0;
+    while (isPivot[freeCol]) {
+        freeCol++;
+    }
+    long long scale = 1;
+    for (int i = 0; i < rank; i++) {
+        long long den = m[i][freeCol].den;
+        if (__builtin_mul_overflow(scale / gcd(scale, den), den, &scale)) {
+            return "Error: coefficients overflow";
+        }
+    }
+    for (int c = 0; c < nSpecies; c++) {
+        scratch->coefficients[c] = 0;
+    }
+    scratch->coefficients[freeCol] = scale;
+    for (int i = 0; i < rank; i++) {
+        if (__builtin_mul_overflow(-m[i][freeCol].num, scale / m[i][freeCol].den, &scratch->coefficients[pivotCol[i]])) {
+            return "Error: coefficients overflow";
+        }
+    }
+
+    long long g = 0;
+    for (int c = 0; c < nSpecies; c++) {
+        g = gcd(g, scratch->coefficients[c]);
+    }
+    int positive = 1;
+    int negative = 1;
+    for (int c = 0; c < nSpecies; c++) {
+        scratch->coefficients[c] /= g;
+        positive = positive && scratch->coefficients[c] > 0;
+        negative = negative && scratch->coefficients[c] < 0;
+    }
+    if (negative) {
+        for (int c = 0; c < nSpecies; c++) {
+            scratch->coefficients[c] = -scratch->coefficients[c];
+        }
+    } else if (!positive) {
+        return "Error: reaction is inconsistent";
+    }
+    return NULL;
+}
+
+/**
+ * @brief Balances a reaction and appends the balanced reaction or an error line.
+ *
+ * @param reaction     The reaction text (null-terminated).
+ * @param strArr       Array of element names.
+ * @param strcapacity  Number of elements in strArr.
+ * @param scratch      Working memory of the calling thread.
+ * @param out          Pointer to the output buffer the result line is appended to.
+ * @param outLen       Pointer to the current length of the output buffer.
+ * @param outCapacity  Pointer to the capacity of the output buffer.
+ */
+void balancereaction(char *reaction, char **strArr, int strcapacity, BalanceScratch *scratch, char **out, size_t *outLen, size_t *outCapacity) {
+    int nSpecies = 0;
+    int nReactants = 0;
+    int nRows = 0;
+    const char *error = NULL;
+    char *arrow = strstr(reaction, "->");
+
+    if (arrow == NULL || splitSpecies(reaction, arrow, scratch, &nSpecies) != 0) {
+        error = "Error: cannot parse reaction";
+    } else {
+        nReactants = nSpecies;
+        if (splitSpecies(arrow + 2, reaction + strlen(reaction), scratch, &nSpecies) != 0
+            || buildMatrix(strArr, scratch, nSpecies, nReactants, &nRows) != 0) {
+            error = "Error: cannot parse reaction";
+        } else {
+            error = solveMatrix(scratch, nRows, nSpecies);
+        }
+    }
+    if (error != NULL) {
+        pushChars(out, outLen, outCapacity, error);
+        pushChars(out, outLen, outCapacity, ": ");
+        pushChars(out, outLen, outCapacity, reaction);
+        pushChars(out, outLen, outCapacity, "\n");
+        return;
+    }
+
+    for (int s = 0; s < nSpecies; s++) {
+        char number[24];
+        if (s > 0) {
+            pushChars(out, outLen, outCapacity, s == nReactants ? " -> " : " + ");
+        }
+        if (scratch->coefficients[s] != 1) {
+            sprintf(number, "%lld ", scratch->coefficients[s]);
+            pushChars(out, outLen, outCapacity, number);
+        }
+        // Terminate the species in place while it is copied
+        char *end = (char *)scratch->species[s] + scratch->speciesLen[s];
+        char saved = *end;
+        *end = '\0';
+        pushChars(out, outLen, outCapacity, scratch->species[s]);
+        *end = saved;
+    }
+    pushChars(out, outLen, outCapacity, "\n");
+}
@@ -0,0 +1,81 @@
+/**
+ * @file balance.h
+ * @brief Header file for balancing chemical reactions.
+ * @author agent
+ * @since 18/10/2026
+ * This header file declares functions for finding the smallest integer coefficients
+ * of a reaction such as "H2 + O2 -> H2O".
+ */
+
+#ifndef BALANCE_H
+#define BALANCE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** Maximum number of species (reactants and products) in a reaction. */
+#define BALANCE_MAX_SPECIES 32
+
+/** Maximum number of distinct elements in a reaction. */
+#define BALANCE_MAX_ELEMENTS 32
+
+/**
+ * @brief An exact fraction num/den with den > 0, kept in lowest terms.
+ */
+typedef struct {
+    long long num; /**< Numerator. */
+    long long den; /**< Denominator. */
+} Rational;
+
+/**
+ * @brief Working memory for balancing reactions, reused from one reaction to the next.
+ *
+ * Each evaluator thread owns one scratch, so balancing allocates nothing per reaction.
+ */
+typedef struct {
+    int strcapacity;                                             /**< Number of elements in the table. */
+    int *counts;                                                 /**< Atom counts of one species, indexed like the element table. */
+    int *rowOf;                                                  /**< Matrix row of each table element, or -1. */
+    int rowElement[BALANCE_MAX_ELEMENTS];                        /**< Table element of each matrix row. */
+    const char *species[BALANCE_MAX_SPECIES];                    /**< Start of each species in the reaction text. */
+    int speciesLen[BALANCE_MAX_SPECIES];                         /**< Length of each species. */
+    Rational matrix[BALANCE_MAX_ELEMENTS][BALANCE_MAX_SPECIES];  /**< Element-by-species matrix. */
+    long long coefficients[BALANCE_MAX_SPECIES];                 /**< Balanced coefficients. */
+} BalanceScratch;
+
+/**
+ * @brief Allocates balancing scratch memory for an element table.
+ *
+ * @param strcapacity  Number of elements in the element table.
+ *
+ * @return The scratch, or NULL on allocation failure.
+ */
+BalanceScratch *newBalanceScratch(int strcapacity);
+
+/**
+ * @brief Frees balancing scratch memory.
+ *
+ * @param scratch  The scratch to free (may be NULL).
+ */
+void freeBalanceScratch(BalanceScratch *scratch);
+
+/**
+ * @brief Balances a reaction and appends the balanced reaction or an error line.
+ *
+ * The reaction has the form "A + B -> C + D". The coefficients are the smallest positive
+ * integers that conserve every element, found by exact rational Gaussian elimination on
+ * the element-by-species matrix. Reactions with no positive solution are reported as
+ * inconsistent, and reactions with more than one independent solution as underdetermined.
+ * An error line ends with the reaction text, e.g. "Error: cannot parse reaction: H2 ->".
+ *
+ * @param reaction     The reaction text (null-terminated).
+ * @param strArr       Array of element names.
+ * @param strcapacity  Number of elements in strArr.
+ * @param scratch      Working memory of the calling thread.
+ * @param out          Pointer to the output buffer the result line is appended to.
+ * @param outLen       Pointer to the current length of the output buffer.
+ * @param outCapacity  Pointer to the capacity of the output buffer.
+ */
+void balancereaction(char *reaction, char **strArr, int strcapacity, BalanceScratch *scratch, char **out, size_t *outLen, size_t *outCapacity);
+
+#endif
@@ -7,6 +7,7 @@
  * 
  */
 
+#include <stdint.h>
 #include "data.h"
 #include "stack.h"
 
@@ -36,11 +37,53 @@ int pushInt(short **intArr, int *intCount, int *intCapacity, short num) {
     return 0;
 }
 
+/**
+ * @brief Appends a string to a character buffer, expanding the buffer if necessary.
+ * 
+ * The buffer is not null-terminated; its contents are the first *len bytes. The 
+ * capacity is doubled until the appended string fits.
+ * 
+ * @param buf          Pointer to the character buffer.
+ * @param len          Pointer to the current length of the buffer contents.
+ * @param capacity     Pointer to the current capacity of the buffer.
+ * @param str          The string to append (without its terminating null byte).
+ * 
+ * @return 0 on success, or 1 on failure (memory allocation error or size overflow).
+ */
+int pushChars(char **buf, size_t *len, size_t *capacity, const char *str) {
+    size_t strLen = strlen(str);
+    if (strLen > SIZE_MAX - *len) {
+        fprintf(stderr, "Error: character buffer too large\n");
+        return 1;
+    }
+    if (*len + strLen > *capacity) {
+        size_t newCapacity = *capacity;
+        while (*len + strLen > newCapacity) {
+            if (newCapacity > SIZE_MAX / 2) {
+                newCapacity = *len + strLen;
+                break;
+            }
+            newCapacity *= 2;
+        }
+        char *temp = (char *)realloc(*buf, newCapacity * sizeof(char));
+        if (temp == NULL) {
+            perror("Error reallocating memory for characters\n");
+            return 1;
+        }
+        *buf = temp;
+        *capacity = newCapacity;
+    }
+    memcpy(*buf + *len, str, strLen);
+    *len += strLen;
+    return 0;
+}
+
 /**
  * @brief Reads data from a file and populates arrays for integers and strings.
  * 
- * This function reads pairs of strings and short integers from a file. It populates 
- * the provided integer and string arrays while dynamically managing their memory.
+ * This function reads a string and a short integer from each line of a file. It populates 
+ * the provided integer and string arrays while dynamically managing their memory. Any 
+ * further columns (such as the isotope data of an extended table) are ignored.
  * 
  * @param fp           Pointer to the file stream to read from.
  * @param intArr       Pointer to an array of short integers to populate.
@@ -53,6 +96,7 @@ int pushInt(short **intArr, int *intCount, int *intCapacity, short num) {
 int readData(FILE *fp, short **intArr, char ***strArr, int *intSize, int *strSize) {
     short num;
     char str[100];
+    char line[4096];
     int intCount = 0;
     int strCount = 0;
     int intCapacity = 10; 
@@ -67,7 +111,14 @@ int readData(FILE *fp, short **intArr, char ***strArr, int *intSize, int *strSiz
     }
 
    
-    while (fscanf(fp, "%s %hd", str, &num) == 2) {
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        int fields = sscanf(line, "%99s %hd", str, &num);
+        if (fields == EOF) {
+            continue; 
+        }
+        if (fields != 2) {
+            break; 
+        }
         if (pushInt(intArr, &intCount, &intCapacity, num) != 0) {
             return 1; 
         }
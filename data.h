@@ -25,6 +25,18 @@
  */
 int pushInt(short **intArr, int *intCount, int *intCapacity, short num);
 
+/**
+ * @brief Appends a string to a character buffer, expanding the buffer if necessary.
+ * 
+ * @param buf          Pointer to the character buffer.
+ * @param len          Pointer to the current length of the buffer contents.
+ * @param capacity     Pointer to the current capacity of the buffer.
+ * @param str          The string to append (without its terminating null byte).
+ * 
+ * @return 0 on success, or 1 on failure (memory allocation error or size overflow).
+ */
+int pushChars(char **buf, size_t *len, size_t *capacity, const char *str);
+
 /**
  * @brief Reads data from a file and populates arrays for integers and strings.
  * 
@@ -0,0 +1,394 @@
+/**
+ * @file isotope.c
+ * @brief Implements isotope data reading and isotopic pattern computation.
+ * @author agent
+ * @since 18/10/2026
+ * This source file includes implementations for reading the isotope columns of an
+ * extended element table and for convolving isotope distributions into the isotopic
+ * pattern of a formula.
+ */
+
+#include <string.h>
+#include "isotope.h"
+#include "parser.h"
+#include "data.h"
+
+/** Maximum number of isotopes read per element. */
+#define ISOTOPE_MAX_PER_ELEMENT 64
+
+/**
+ * @brief Reads the isotope columns of an extended element table.
+ *
+ * Lines without isotope columns, or naming an element missing from strArr, are skipped.
+ *
+ * @param fp           Pointer to the file stream to read from (closed on return).
+ * @param strArr       Array of element names, as read by readData().
+ * @param strcapacity  Number of elements in strArr.
+ * @param table        Receives the isotope data.
+ *
+ * @return 0 on success, or 1 on failure (memory allocation error).
+ */
+int readIsotopes(FILE *fp, char **strArr, int strcapacity, IsotopeTable *table) {
+    char line[4096];
+    char str[100];
+    short num;
+    int offset;
+    Peak isotopes[ISOTOPE_MAX_PER_ELEMENT];
+
+    table->strcapacity = strcapacity;
+    table->threshold = ISOTOPE_DEFAULT_THRESHOLD;
+    table->isotopes = (Peak **)calloc(strcapacity, sizeof(Peak *));
+    table->isotopeCount = (int *)calloc(strcapacity, sizeof(int));
+    if (table->isotopes == NULL || table->isotopeCount == NULL) {
+        perror("Error allocating memory\n");
+        fclose(fp);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "%99s %hd%n", str, &num, &offset) != 2) {
+            continue;
+        }
+        int j = 0;
+        while (j < strcapacity && strcmp(strArr[j], str) != 0) {
+            j++;
+        }
+        if (j == strcapacity || table->isotopes[j] != NULL) {
+            continue;
+        }
+
+        // Read "mass abundance" pairs
+        int count = 0;
+        double total = 0;
+        char *p = line + offset;
+        while (count < ISOTOPE_MAX_PER_ELEMENT) {
+            char *end;
+            double mass = strtod(p, &end);
+            if (end == p) {
+                break;
+            }
+            p = end;
+            double abundance = strtod(p, &end);
+            if (end == p) {
+                break;
+            }
+            p = end;
+            isotopes[count].mass = mass;
+            isotopes[count].abundance = abundance;
+            isotopes[count].nucleons = (int)(mass + 0.5);
+            total += abundance;
+            count++;
+        }
+        if (count == 0 || total <= 0) {
+            continue;
+        }
+
+        table->isotopes[j] = (Peak *)malloc(count * sizeof(Peak));
+        if (table->isotopes[j] == NULL) {
+            perror("Error allocating memory\n");
+            fclose(fp);
+            return 1;
+        }
+        for (int k = 0; k < count; k++) {
+            table->isotopes[j][k] = isotopes[k];
+            table->isotopes[j][k].abundance /= total;
+        }
+        table->isotopeCount[j] = count;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+/**
+ * @brief Frees the isotope data of a table.
+ *
+ * @param table  The table to free.
+ */
+void freeIsotopes(IsotopeTable *table) {
+    for (int j = 0; j < table->strcapacity; j++) {
+        free(table->isotopes[j]);
+    }
+    free(table->isotopes);
+    free(table->isotopeCount);
+}
+
+/**
+ * @brief Allocates isotopic pattern scratch memory for an element table.
+ *
+ * @param strcapacity  Number of elements in the element table.
+ *
+ * @return The scratch, or NULL on allocation failure.
+ */
+IsotopeScratch *newIsotopeScratch(int strcapacity) {
+    IsotopeScratch *scratch = (IsotopeScratch *)calloc(1, sizeof(IsotopeScratch));
+    if (scratch == NULL) {
+        return NULL;
+    }
+    scratch->counts = (int *)malloc(strcapacity * sizeof(int));
+    if (scratch->counts == NULL) {
+        free(scratch);
+        return NULL;
+    }
+    return scratch;
+}
+
+/**
+ * @brief Frees isotopic pattern scratch memory.
+ *
+ * @param scratch  The scratch to free (may be NULL).
+ */
+void freeIsotopeScratch(IsotopeScratch *scratch) {
+    if (scratch == NULL) {
+        return;
+    }
+    for (int k = 0; k < 4; k++) {
+        free(scratch->lists[k].peaks);
+    }
+    free(scratch->counts);
+    free(scratch);
+}
+
+/**
+ * @brief Makes sure a peak list can hold a number of peaks.
+ *
+ * @param list      The peak list.
+ * @param capacity  Number of peaks needed.
+ *
+ * @return 0 on success, or 1 on failure (memory allocation error).
+ */
+static int reservePeaks(PeakList *list, int capacity) {
+    if (capacity <= list->capacity) {
+        return 0;
+    }
+    int newCapacity = list->capacity > 0 ? list->capacity : 16;
+    while (newCapacity < capacity) {
+        newCapacity *= 2;
+    }
+    Peak *temp = (Peak *)realloc(list->peaks, newCapacity * sizeof(Peak));
+    if (temp == NULL) {
+        return 1;
+    }
+    list->peaks = temp;
+    list->capacity = newCapacity;
+    return 0;
+}
+
+/**
+ * @brief Drops the peaks below the threshold times the largest peak, keeping their order.
+ *
+ * The remaining abundances are rescaled so that the largest peak is 1. Only relative
+ * intensities are reported, and the rescaling keeps the abundances of formulas with
+ * millions of atoms from underflowing to zero.
+ *
+ * @param list       The peak list.
+ * @param threshold  Relative threshold.
+ */
+static void prunePeaks(PeakList *list, double threshold) {
+    double max = 0;
+    for (int i = 0; i < list->count; i++) {
+        if (list->peaks[i].abundance > max) {
+            max = list->peaks[i].abundance;
+        }
+    }
+    int n = 0;
+    for (int i = 0; i < list->count; i++) {
+        if (list->peaks[i].abundance > 0 && list->peaks[i].abundance >= threshold * max) {
+            list->peaks[n] = list->peaks[i];
+            list->peaks[n].abundance /= max;
+            n++;
+        }
+    }
+    list->count = n;
+}
+
+/**
+ * @brief Returns the bin a peak is accumulated in: its nucleon count for the aggregate
+ * pattern, or its mass in units of ISOTOPE_FINE_RESOLUTION for the fine pattern.
+ *
+ * @param peak       The peak.
+ * @param aggregate  1 for the aggregate pattern, 0 for the fine pattern.
+ *
+ * @return The bin number.
+ */
+static long peakBin(const Peak *peak, int aggregate) {
+    return aggregate ? peak->nucleons : (long)(peak->mass / ISOTOPE_FINE_RESOLUTION);
+}
+
+/**
+ * @brief Convolves two patterns, merging coinciding peaks and pruning small ones.
+ *
+ * Both patterns are accumulated into dense bins, so neither needs a sort: the aggregate
+ * pattern has one bin per nucleon count, the fine pattern one bin per
+ * ISOTOPE_FINE_RESOLUTION Da, and neighbouring fine peaks closer than that are merged.
+ * Merged peaks keep their abundance-weighted mean mass.
+ *
+ * @param a          First pattern.
+ * @param b          Second pattern (may be the same as a).
+ * @param out        Receives the convolution; must differ from a and b.
+ * @param aggregate  1 for the aggregate pattern, 0 for the fine pattern.
+ * @param threshold  Relative pruning threshold.
+ *
+ * @return NULL on success, or the error message.
+ */
+static const char *convolve(const PeakList *a, const PeakList *b, PeakList *out, int aggregate, double threshold) {
+    long minA = peakBin(&a->peaks[0], aggregate), maxA = minA;
+    long minB = peakBin(&b->peaks[0], aggregate), maxB = minB;
+    for (int i = 1; i < a->count; i++) {
+        long bin = peakBin(&a->peaks[i], aggregate);
+        minA = bin < minA ? bin : minA;
+        maxA = bin > maxA ? bin : maxA;
+    }
+    for (int j = 1; j < b->count; j++) {
+        long bin = peakBin(&b->peaks[j], aggregate);
+        minB = bin < minB ? bin : minB;
+        maxB = bin > maxB ? bin : maxB;
+    }
+    // Fine bins do not add exactly: allow one bin either way for fractions and rounding
+    long first = minA + minB - (aggregate ? 0 : 1);
+    long last = maxA + maxB + (aggregate ? 0 : 1);
+    long span = last - first + 1;
+    if (span > ISOTOPE_MAX_BINS) {
+        return "Error: pattern too wide";
+    }
+    if (reservePeaks(out, (int)span) != 0) {
+        return "Error: out of memory";
+    }
+
+    // Sum abundance-weighted masses first and divide by the abundance afterwards
+    for (long k = 0; k < span; k++) {
+        out->peaks[k].mass = 0;
+        out->peaks[k].abundance = 0;
+        out->peaks[k].nucleons = 0;
+    }
+    for (int i = 0; i < a->count; i++) {
+        for (int j = 0; j < b->count; j++) {
+            Peak sum;
+            sum.mass = a->peaks[i].mass + b->peaks[j].mass;
+            sum.nucleons = a->peaks[i].nucleons + b->peaks[j].nucleons;
+            Peak *peak = &out->peaks[peakBin(&sum, aggregate) - first];
+            double abundance = a->peaks[i].abundance * b->peaks[j].abundance;
+            peak->mass += sum.mass * abundance;
+            peak->abundance += abundance;
+            peak->nucleons = sum.nucleons;
+        }
+    }
+
+    // Keep the occupied bins in mass order
+    int n = 0;
+    for (long k = 0; k < span; k++) {
+        Peak *peak = &out->peaks[k];
+        if (peak->abundance <= 0) {
+            continue;
+        }
+        peak->mass /= peak->abundance;
+        Peak *previous = n > 0 ? &out->peaks[n - 1] : NULL;
+        if (!aggregate && previous != NULL && peak->mass - previous->mass < ISOTOPE_FINE_RESOLUTION) {
+            double abundance = previous->abundance + peak->abundance;
+            previous->mass = (previous->mass * previous->abundance + peak->mass * peak->abundance) / abundance;
+            previous->abundance = abundance;
+        } else {
+            out->peaks[n++] = *peak;
+        }
+    }
+    out->count = n;
+    prunePeaks(out, threshold);
+    return NULL;
+}
+
+/**
+ * @brief Sets a pattern to the single peak of zero atoms.
+ *
+ * @param list  The pattern.
+ */
+static void setEmptyPattern(PeakList *list) {
+    reservePeaks(list, 1);
+    list->peaks[0].mass = 0;
+    list->peaks[0].abundance = 1;
+    list->peaks[0].nucleons = 0;
+    list->count = 1;
+}
+
+/**
+ * @brief Computes the isotopic pattern of a formula and appends it as one line.
+ *
+ * @param formula      The formula (null-terminated).
+ * @param strArr       Array of element names.
+ * @param table        Isotope data of the elements.
+ * @param aggregate    1 to merge peaks by nucleon count, 0 for the fine pattern.
+ * @param scratch      Working memory of the calling thread.
+ * @param out          Pointer to the output buffer the result line is appended to.
+ * @param outLen       Pointer to the current length of the output buffer.
+ * @param outCapacity  Pointer to the capacity of the output buffer.
+ */
+void isotopepattern(char *formula, char **strArr, IsotopeTable *table, int aggregate, IsotopeScratch *scratch, char **out, size_t *outLen, size_t *outCapacity) {
+    char text[128];
+    PeakList *pattern = &scratch->lists[0];
+    PeakList *power = &scratch->lists[1];
+    PeakList *base = &scratch->lists[2];
+    PeakList *tmp = &scratch->lists[3];
+    PeakList *swap;
+    const char *error = NULL;
+
+    memset(scratch->counts, 0, table->strcapacity * sizeof(int));
+    if (countElements(formula, strlen(formula), strArr, table->strcapacity, scratch->counts) != 0) {
+        pushChars(out, outLen, outCapacity, "Error: cannot parse formula\n");
+        return;
+    }
+
+    setEmptyPattern(pattern);
+    for (int j = 0; j < table->strcapacity; j++) {
+        int n = scratch->counts[j];
+        if (n == 0) {
+            continue;
+        }
+        if (table->isotopes[j] == NULL) {
+            snprintf(text, sizeof(text), "Error: no isotope data for %s\n", strArr[j]);
+            pushChars(out, outLen, outCapacity, text);
+            return;
+        }
+
+        // Raise the element's isotope distribution to the n-th power by repeated squaring
+        if (reservePeaks(base, table->isotopeCount[j]) != 0) {
+            pushChars(out, outLen, outCapacity, "Error: out of memory\n");
+            return;
+        }
+        memcpy(base->peaks, table->isotopes[j], table->isotopeCount[j] * sizeof(Peak));
+        base->count = table->isotopeCount[j];
+        setEmptyPattern(power);
+        while (n > 0) {
+            if (n & 1) {
+                if ((error = convolve(power, base, tmp, aggregate, table->threshold)) != NULL) {
+                    break;
+                }
+                swap = power; power = tmp; tmp = swap;
+            }
+            n >>= 1;
+            if (n > 0) {
+                if ((error = convolve(base, base, tmp, aggregate, table->threshold)) != NULL) {
+                    break;
+                }
+                swap = base; base = tmp; tmp = swap;
+            }
+        }
+
+        if (error != NULL || (error = convolve(pattern, power, tmp, aggregate, table->threshold)) != NULL) {
+            pushChars(out, outLen, outCapacity, error);
+            pushChars(out, outLen, outCapacity, "\n");
+            return;
+        }
+        swap = pattern; pattern = tmp; tmp = swap;
+    }
+
+    double max = 0;
+    for (int i = 0; i < pattern->count; i++) {
+        if (pattern->peaks[i].abundance > max) {
+            max = pattern->peaks[i].abundance;
+        }
+    }
+    for (int i = 0; i < pattern->count; i++) {
+        snprintf(text, sizeof(text), "%s%.6f:%.4f", i > 0 ? " " : "", pattern->peaks[i].mass, 100 * pattern->peaks[i].abundance / max);
+        pushChars(out, outLen, outCapacity, text);
+    }
+    pushChars(out, outLen, outCapacity, "\n");
+}
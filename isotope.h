@@ -0,0 +1,119 @@
+/**
+ * @file isotope.h
+ * @brief Header file for isotope data and isotopic pattern computation.
+ * @author agent
+ * @since 18/10/2026
+ * This header file declares functions for reading isotope masses and abundances and for
+ * computing the isotopic pattern (mass spectrum) of chemical formulas.
+ */
+
+#ifndef ISOTOPE_H
+#define ISOTOPE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** Default peak threshold, relative to the most abundant peak. */
+#define ISOTOPE_DEFAULT_THRESHOLD 1e-4
+
+/** Bin width of the fine pattern in Da; closer peaks are merged. */
+#define ISOTOPE_FINE_RESOLUTION 5e-4
+
+/** Maximum number of bins of one convolution, bounding its memory. */
+#define ISOTOPE_MAX_BINS (1 << 22)
+
+/**
+ * @brief A peak of an isotopic pattern.
+ */
+typedef struct {
+    double mass;      /**< Mass in Da. */
+    double abundance; /**< Probability of the peak. */
+    int nucleons;     /**< Nucleon count, used to group peaks of the aggregate pattern. */
+} Peak;
+
+/**
+ * @brief Isotopes of every element of the element table.
+ */
+typedef struct {
+    int strcapacity;    /**< Number of elements in the table. */
+    Peak **isotopes;    /**< Isotopes of each element, indexed like the element names, or NULL. */
+    int *isotopeCount;  /**< Number of isotopes of each element. */
+    double threshold;   /**< Peaks below threshold times the largest peak are pruned. */
+} IsotopeTable;
+
+/**
+ * @brief A growable list of peaks.
+ */
+typedef struct {
+    Peak *peaks;   /**< The peaks. */
+    int count;     /**< Number of peaks in use. */
+    int capacity;  /**< Allocated number of peaks. */
+} PeakList;
+
+/**
+ * @brief Working memory for isotopic patterns, reused from one formula to the next.
+ */
+typedef struct {
+    int *counts;       /**< Atom counts of the formula, indexed like the element names. */
+    PeakList lists[4]; /**< Pattern, element power, squaring base and convolution output. */
+} IsotopeScratch;
+
+/**
+ * @brief Reads the isotope columns of an extended element table.
+ *
+ * Each line holds a symbol, an atomic number and optional "mass abundance" pairs, e.g.
+ * "C 6 12.0 0.9893 13.0033548378 0.0107". Abundances are normalized to sum to 1.
+ *
+ * @param fp           Pointer to the file stream to read from (closed on return).
+ * @param strArr       Array of element names, as read by readData().
+ * @param strcapacity  Number of elements in strArr.
+ * @param table        Receives the isotope data.
+ *
+ * @return 0 on success, or 1 on failure (memory allocation error).
+ */
+int readIsotopes(FILE *fp, char **strArr, int strcapacity, IsotopeTable *table);
+
+/**
+ * @brief Frees the isotope data of a table.
+ *
+ * @param table  The table to free.
+ */
+void freeIsotopes(IsotopeTable *table);
+
+/**
+ * @brief Allocates isotopic pattern scratch memory for an element table.
+ *
+ * @param strcapacity  Number of elements in the element table.
+ *
+ * @return The scratch, or NULL on allocation failure.
+ */
+IsotopeScratch *newIsotopeScratch(int strcapacity);
+
+/**
+ * @brief Frees isotopic pattern scratch memory.
+ *
+ * @param scratch  The scratch to free (may be NULL).
+ */
+void freeIsotopeScratch(IsotopeScratch *scratch);
+
+/**
+ * @brief Computes the isotopic pattern of a formula and appends it as one line.
+ *
+ * The pattern of each element is its isotope distribution raised to the atom count by
+ * repeated squaring, and the element patterns are convolved together. Peaks below the
+ * table threshold are pruned after every convolution, and fine peaks closer than
+ * ISOTOPE_FINE_RESOLUTION are merged. The line lists "mass:intensity" pairs in
+ * increasing mass, with intensities relative to the largest peak (100).
+ *
+ * @param formula      The formula (null-terminated).
+ * @param strArr       Array of element names.
+ * @param table        Isotope data of the elements.
+ * @param aggregate    1 to merge peaks by nucleon count, 0 for the fine pattern.
+ * @param scratch      Working memory of the calling thread.
+ * @param out          Pointer to the output buffer the result line is appended to.
+ * @param outLen       Pointer to the current length of the output buffer.
+ * @param outCapacity  Pointer to the capacity of the output buffer.
+ */
+void isotopepattern(char *formula, char **strArr, IsotopeTable *table, int aggregate, IsotopeScratch *scratch, char **out, size_t *outLen, size_t *outCapacity);
+
+#endif
@@ -13,14 +13,44 @@
 #include <string.h>
 #include "data.h"
 #include "parser.h"
+#include "stream.h"
+#include "shard.h"
+#include "isotope.h"
+
+/**
+ * @brief Runs the formula pipeline over the whole input or over one shard of it.
+ * 
+ * @param intArr      Array of atomic data.
+ * @param strArr      Array of element names.
+ * @param strSize     Number of elements in strArr.
+ * @param flag        Processing mode flag.
+ * @param isotopes    Isotope data for -iso and -isoa (may be NULL otherwise).
+ * @param input       Input stream.
+ * @param inputFile   Path to the input file.
+ * @param outputFile  Path to the output file.
+ * @param shardK      Shard number, or 0 to process the whole input.
+ * @param shardN      Number of shards, or 0 to process the whole input.
+ * 
+ * @return 0 on success, or 1 on failure.
+ */
+static int runFormulas(short *intArr, char **strArr, int strSize, char *flag, IsotopeTable *isotopes, gzFile input, char *inputFile, char *outputFile, int shardK, int shardN) {
+    if (shardN > 0) {
+        return runShard(intArr, strArr, strSize, flag, isotopes, input, inputFile, outputFile, shardK, shardN);
+    }
+    extentedtype(&intArr, &strArr, strSize, flag, isotopes, input, outputFile);
+    return 0;
+}
 
 /**
  * @brief Main entry point of the program.
  * 
  * This program processes a periodic table and computes various properties 
  * of chemical formulas based on user-specified flags. It can compute total 
- * proton numbers, generate extended versions of formulas, or verify balanced 
- * parentheses in chemical formulas.
+ * proton numbers, generate extended versions of formulas, verify balanced 
+ * parentheses in chemical formulas, balance chemical reactions, or compute 
+ * isotopic patterns. With --shard K/N only the K-th of N 
+ * line-aligned parts of the input is processed, and --merge stitches the 
+ * shard results back together.
  * 
  * @param argc Number of command-line arguments.
  * @param argv Array of command-line arguments.
@@ -28,9 +58,16 @@
  * @return 0 on success, or 1 on failure.
  */
 int main(int argc, char *argv[]) {
+    // Merge shard results: --merge <output.txt> <shard files...>
+    if (argc >= 4 && strcmp(argv[1], "--merge") == 0) {
+        printf("Merging %d shards into %s\n", argc - 3, argv[2]);
+        return mergeShards(argv[2], &argv[3], argc - 3);
+    }
+
     // Check if the correct number of arguments is provided
     if (argc < 5) {
-        fprintf(stderr, "Usage: %s <periodicTable.txt> [-pn|-ext|-v] <input.txt> <output.txt>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <periodicTable.txt> [-pn|-ext|-v|-bal|-iso|-isoa] <input.txt> <output.txt> [--shard K/N] [--threshold T]\n", argv[0]);
+        fprintf(stderr, "       %s --merge <output.txt> <shard files...>\n", argv[0]);
         return 1;
     }
 
@@ -38,9 +75,39 @@ int main(int argc, char *argv[]) {
     char *flag = argv[2];                 
     char *inputFile = argv[3];            
     char *outputFile = argv[4];           
+    int shardK = 0, shardN = 0;
+    double threshold = ISOTOPE_DEFAULT_THRESHOLD;
+    int hasThreshold = 0;
+
+    // Parse the optional arguments
+    for (int i = 5; i < argc; i += 2) {
+        if (i + 1 < argc && strcmp(argv[i], "--shard") == 0) {
+            if (sscanf(argv[i + 1], "%d/%d", &shardK, &shardN) != 2 || shardN < 1 || shardK < 1 || shardK > shardN) {
+                fprintf(stderr, "Invalid shard: %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (i + 1 < argc && strcmp(argv[i], "--threshold") == 0) {
+            if (sscanf(argv[i + 1], "%lf", &threshold) != 1 || threshold < 0 || threshold >= 1) {
+                fprintf(stderr, "Invalid threshold: %s\n", argv[i + 1]);
+                return 1;
+            }
+            hasThreshold = 1;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (shardN > 0 && strcmp(flag, "-v") == 0) {
+        fprintf(stderr, "--shard is not supported with -v\n");
+        return 1;
+    }
+    if (hasThreshold && strcmp(flag, "-iso") != 0 && strcmp(flag, "-isoa") != 0) {
+        fprintf(stderr, "--threshold is only supported with -iso and -isoa\n");
+        return 1;
+    }
 
     // Open the input files and check for errors
-    FILE *input = fopen(inputFile, "r");
+    gzFile input = openInput(inputFile);
     FILE *periodicTable = fopen(periodicTableFile, "r");
     if (!input || !periodicTable) {
         perror("File error");
@@ -60,19 +127,46 @@ int main(int argc, char *argv[]) {
     // Process based on the specified flag
     if (strcmp(flag, "-pn") == 0) {
         printf("Compute total proton number of formulas in %s\n", inputFile);
-        extentedtype(&intArr, &strArr, strSize, flag, input, outputFile);
+        if (runFormulas(intArr, strArr, strSize, flag, NULL, input, inputFile, outputFile, shardK, shardN) != 0) {
+            return 1;
+        }
         printf("Writing formulas to %s\n", outputFile);
     } else if (strcmp(flag, "-ext") == 0) {
         printf("Compute extended version of formulas in %s\n", inputFile);
-        extentedtype(&intArr, &strArr, strSize, flag, input, outputFile);
+        if (runFormulas(intArr, strArr, strSize, flag, NULL, input, inputFile, outputFile, shardK, shardN) != 0) {
+            return 1;
+        }
         printf("Writing formulas to %s\n", outputFile);
+    } else if (strcmp(flag, "-bal") == 0) {
+        printf("Balance reactions in %s\n", inputFile);
+        if (runFormulas(intArr, strArr, strSize, flag, NULL, input, inputFile, outputFile, shardK, shardN) != 0) {
+            return 1;
+        }
+        printf("Writing reactions to %s\n", outputFile);
+    } else if (strcmp(flag, "-iso") == 0 || strcmp(flag, "-isoa") == 0) {
+        printf("Compute isotopic patterns of formulas in %s\n", inputFile);
+        IsotopeTable isotopes;
+        periodicTable = fopen(periodicTableFile, "r");
+        if (!periodicTable) {
+            perror("File error");
+            return 1;
+        }
+        if (readIsotopes(periodicTable, strArr, strSize, &isotopes) != 0) {
+            return 1;
+        }
+        isotopes.threshold = threshold;
+        if (runFormulas(intArr, strArr, strSize, flag, &isotopes, input, inputFile, outputFile, shardK, shardN) != 0) {
+            return 1;
+        }
+        freeIsotopes(&isotopes);
+        printf("Writing isotopic patterns to %s\n", outputFile);
     } else if (strcmp(flag, "-v") == 0) {
         printf("Verify balanced parentheses in %s\n", inputFile);
         int lineNumber = 1, i = 0;
         char formula[100];
 
         // Read and verify each formula from the input file
-        while (fscanf(input, "%s", formula) == 1) {
+        while (readToken(input, formula, sizeof(formula)) == 1) {
             if (isBalanced(formula) == 0) {
                 printf("Error: Unbalanced parenthesis at line %d\n", lineNumber);
             }
@@ -81,6 +175,7 @@ int main(int argc, char *argv[]) {
         }
         if(i==0)
             printf("Parentheses are balanced for all chemical formulas\n");
+        gzclose(input);
     } else {
         // Handle unknown flags
         fprintf(stderr, "Unknown flag: %s\n", flag);
@@ -10,7 +10,10 @@
 #include "parser.h"
 #include "stack.h"
 #include "data.h"
+#include "pipeline.h"
+#include "stream.h"
 #include <ctype.h>
+#include <limits.h>
 
 /**
  * @brief Calculates the number of protons in a given element or compound.
@@ -33,6 +36,89 @@ int calculateprotons(char *stringpegke, short *intArr, char **strArr, char strCo
     return sum;
 }
 
+/**
+ * @brief Adds the number of atoms of each element in a formula to a count array.
+ * 
+ * The formula is read from the end so that every count is known before the element 
+ * or group it applies to, which avoids building token lists or temporary count arrays.
+ * Element symbols are an upper-case letter followed by lower-case letters.
+ * 
+ * @param formula      The formula; it does not need to be null-terminated.
+ * @param len          The length of the formula.
+ * @param strArr       Array of element names.
+ * @param strcapacity  Number of elements in strArr.
+ * @param counts       Array of strcapacity atom counts, indexed like strArr, to add to.
+ * 
+ * @return 0 on success, or 1 if the formula is malformed or names an unknown element.
+ */
+int countElements(const char *formula, int len, char **strArr, int strcapacity, int *counts) {
+    long multipliers[COUNT_MAX_DEPTH + 1];
+    int depth = 0;
+    long pending = 1;
+    int hasPending = 0;
+    multipliers[0] = 1;
+
+    int i = len - 1;
+    while (i >= 0) {
+        char c = formula[i];
+        if (isdigit(c)) {
+            long number = 0;
+            long place = 1;
+            while (i >= 0 && isdigit(formula[i])) {
+                int digit = formula[i] - '0';
+                if (digit != 0 && (place > INT_MAX || number + digit * place > INT_MAX)) {
+                    return 1;
+                }
+                number += digit * place;
+                if (place <= INT_MAX) { // leading zeros may follow
+                    place *= 10;
+                }
+                i--;
+            }
+            pending = number;
+            hasPending = 1;
+        } else if (c == ')') {
+            if (depth == COUNT_MAX_DEPTH || multipliers[depth] * pending > INT_MAX) {
+                return 1;
+            }
+            multipliers[depth + 1] = multipliers[depth] * pending;
+            depth++;
+            pending = 1;
+            hasPending = 0;
+            i--;
+        } else if (c == '(') {
+            if (depth == 0 || hasPending) {
+                return 1;
+            }
+            depth--;
+            i--;
+        } else if (isalpha(c)) {
+            int end = i;
+            while (i >= 0 && islower(formula[i])) {
+                i--;
+            }
+            if (i < 0 || !isupper(formula[i])) {
+                return 1;
+            }
+            int symbolLen = end - i + 1;
+            int j = 0;
+            while (j < strcapacity && (strncmp(&formula[i], strArr[j], symbolLen) != 0 || strArr[j][symbolLen] != '\0')) {
+                j++;
+            }
+            if (j == strcapacity || counts[j] + multipliers[depth] * pending > INT_MAX) {
+                return 1;
+            }
+            counts[j] += multipliers[depth] * pending;
+            pending = 1;
+            hasPending = 0;
+            i--;
+        } else {
+            return 1;
+        }
+    }
+    return depth != 0 || hasPending;
+}
+
 /**
  * @brief Checks if a chemical formula is balanced by matching parentheses.
  * 
@@ -67,25 +153,18 @@ int isBalanced(const char *str) {
 }
 
 /**
- * @brief Processes a formula string, calculating proton counts and managing output.
+ * @brief Processes a formula string, calculating proton counts and appending the result line.
  * 
  * @param formula       The formula to process.
  * @param intArr        Array containing atomic data.
  * @param strArr        Array of element names.
  * @param strCount      Number of elements in strArr.
  * @param flag          Mode flag for processing.
- * @param outputFile    Path to the output file for results.
+ * @param out           Pointer to the output buffer the result line is appended to.
+ * @param outLen        Pointer to the current length of the output buffer.
+ * @param outCapacity   Pointer to the capacity of the output buffer.
  */
-void processtype(char *formula, short *intArr, char **strArr, char strCount, char *flag, char *outputFile) {
-    FILE *fp2 = NULL;
-    if (strcmp(flag, "-ext") == 0 || strcmp(flag, "-pn") == 0) {
-        fp2 = fopen(outputFile, "a+");
-        if (fp2 == NULL) {
-            perror("Unable to open file");
-            exit(1);
-        }
-    }
-
+void processtype(char *formula, short *intArr, char **strArr, char strCount, char *flag, char **out, size_t *outLen, size_t *outCapacity) {
     int stackCapacity = 1000;
     char **stack = (char **)malloc(stackCapacity * sizeof(char *));
     int top = 0;
@@ -180,78 +259,111 @@ void processtype(char *formula, short *intArr, char **strArr, char strCount, cha
     }
 
     if (strcmp(flag, "-ext") == 0) {
-        fprintf(fp2, "%s\n", result);
+        strcat(result, "\n");
+        pushChars(out, outLen, outCapacity, result);
     } else if (strcmp(flag, "-pn") == 0) {
-        fprintf(fp2, "%d\n", totalProtons);
+        char line[16];
+        sprintf(line, "%d\n", totalProtons);
+        pushChars(out, outLen, outCapacity, line);
     }
-    fflush(fp2);
-    fclose(fp2);
     free(result);
     free(stack);
     free(formulaStack);
 }
 
 /**
- * @brief Extends types and processes input data.
+ * @brief Splits a formula into element, digit and parenthesis tokens and evaluates it.
  * 
- * @param intArr       Pointer to an array of atomic data.
- * @param strArr       Pointer to an array of element names.
- * @param strcapacity  Capacity of strArr.
+ * @param str          The raw formula as read from the input.
+ * @param intArr       Array of atomic data.
+ * @param strArr       Array of element names.
+ * @param strcapacity  Number of elements in strArr.
  * @param flag         Processing mode flag.
- * @param inputFile    Input file for reading.
- * @param outputFile   Output file path for results.
+ * @param out          Pointer to the output buffer the result line is appended to.
+ * @param outLen       Pointer to the current length of the output buffer.
+ * @param outCapacity  Pointer to the capacity of the output buffer.
  */
-void extentedtype(short **intArr, char ***strArr, int strcapacity, char *flag, FILE *inputFile, char *outputFile) {
+void evaluateformula(char *str, short *intArr, char **strArr, int strcapacity, char *flag, char **out, size_t *outLen, size_t *outCapacity) {
     int strCount = 0;
     int strCapacity = strcapacity;
-    int count = 0;
     char stringpegke3[100];
     char **stringpegke = (char **)malloc(strCapacity * sizeof(char *));
-    char str[100];
+    if (stringpegke == NULL) {
+        perror("Error allocating memory\n");
+        exit(1);
+    }
 
+    stringpegke3[0] = '\0';
+    for (int i = 0; i < strlen(str); i++) {
+        if (str[i] == '(' || str[i] == ')') { 
+            char temp[2] = {str[i], '\0'};
+            pushStr(&stringpegke, &strCount, &strCapacity, temp);
+        } else if (isdigit(str[i]) && isdigit(str[i + 1])) {
+            char temp[3] = {str[i], str[i + 1], '\0'};
+            pushStr(&stringpegke, &strCount, &strCapacity, temp);
+            i++;
+        } else if (isdigit(str[i])) {
+            char temp[2] = {str[i], '\0'};
+            pushStr(&stringpegke, &strCount, &strCapacity, temp);
+        } else {
+            int matched = 0;
+            int b = 3;
+            matchAndPush(&stringpegke, &strCount, &strCapacity, str, &i, &strArr, strcapacity, &matched, b);
+            if (!matched) {
+                b = 2;
+                matchAndPush(&stringpegke, &strCount, &strCapacity, str, &i, &strArr, strcapacity, &matched, b);
+            }
+            if (!matched) {
+                b = 1;
+                matchAndPush(&stringpegke, &strCount, &strCapacity, str, &i, &strArr, strcapacity, &matched, b);
+            }
+        }
+    }
+    for (int i = 0; i < strCount; i++) {
+        strcat(stringpegke3, stringpegke[i]);
+    }
+    processtype(stringpegke3, intArr, strArr, strcapacity, flag, out, outLen, outCapacity);
+    for (int i = 0; i < strCount; i++) {
+        free(stringpegke[i]);
+    }
+    free(stringpegke);
+}
+
+/**
+ * @brief Extends types and processes input data.
+ * 
+ * The formulas are evaluated by a reader / evaluator / writer pipeline (see pipeline.h),
+ * so reading the input, evaluating formulas and writing results overlap in time. The 
+ * output file is opened once in append mode and results keep the input order. Output
+ * files named "*.gz" are gzip-compressed as they are written.
+ * 
+ * @param intArr       Pointer to an array of atomic data.
+ * @param strArr       Pointer to an array of element names.
+ * @param strcapacity  Capacity of strArr.
+ * @param flag         Processing mode flag.
+ * @param isotopes     Isotope data for -iso and -isoa (may be NULL otherwise).
+ * @param inputFile    Input stream for reading.
+ * @param outputFile   Output file path for results.
+ */
+void extentedtype(short **intArr, char ***strArr, int strcapacity, char *flag, IsotopeTable *isotopes, gzFile inputFile, char *outputFile) {
     if (inputFile == NULL) {
         perror("Unable to open file");
         exit(1);
     }
+    gzFile fp2 = openOutput(outputFile, "a");
+    if (fp2 == NULL) {
+        perror("Unable to open file");
+        exit(1);
+    }
 
-    while (fscanf(inputFile, "%s", str) == 1) {
-        stringpegke3[0] = '\0';
-        for (int i = 0; i < strlen(str); i++) {
-            if (str[i] == '(' || str[i] == ')') { 
-                count++;
-                char temp[2] = {str[i], '\0'};
-                pushStr(&stringpegke, &strCount, &strCapacity, temp);
-            } else if (isdigit(str[i]) && isdigit(str[i + 1])) {
-                char temp[3] = {str[i], str[i + 1], '\0'};
-                pushStr(&stringpegke, &strCount, &strCapacity, temp);
-                i++;
-            } else if (isdigit(str[i])) {
-                char temp[2] = {str[i], '\0'};
-                pushStr(&stringpegke, &strCount, &strCapacity, temp);
-            } else {
-                int matched = 0;
-                int b = 3;
-                matchAndPush(&stringpegke, &strCount, &strCapacity, str, &i, strArr, strcapacity, &matched, b);
-                if (!matched) {
-                    b = 2;
-                    matchAndPush(&stringpegke, &strCount, &strCapacity, str, &i, strArr, strcapacity, &matched, b);
-                }
-                if (!matched) {
-                    b = 1;
-                    matchAndPush(&stringpegke, &strCount, &strCapacity, str, &i, strArr, strcapacity, &matched, b);
-                }
-            }
-        }
-        for (int i = 0; i < strCount; i++) {
-            strcat(stringpegke3, stringpegke[i]);
-        }
-        processtype(stringpegke3, *intArr, *strArr, strcapacity, flag, outputFile);
-        for (int i = 0; i < strCount; i++) {
-            free(stringpegke[i]);
-        }
-        strCount = 0;
+    if (runPipeline(inputFile, fp2, *intArr, *strArr, strcapacity, flag, isotopes, defaultEvaluators(), -1, NULL) != 0) {
+        exit(1);
+    }
+    if (gzclose(fp2) != Z_OK) {
+        perror("Error closing output file");
+        exit(1);
     }
-    fclose(inputFile);
+    gzclose(inputFile);
 }
 
 /**
@@ -13,6 +13,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <zlib.h>
+#include "isotope.h"
+
+/** Maximum nesting depth of parentheses accepted by countElements(). */
+#define COUNT_MAX_DEPTH 64
 
 /**
  * @brief Processes a chemical formula and performs operations based on specified parameters.
@@ -22,9 +27,25 @@
  * @param strArr       Array of strings for storing parsed elements.
  * @param strCount     The count of strings in strArr.
  * @param flag         Pointer to a flag that determines specific processing rules.
- * @param outputFile   Pointer to a string representing the output file path.
+ * @param out          Pointer to the output buffer the result line is appended to.
+ * @param outLen       Pointer to the current length of the output buffer.
+ * @param outCapacity  Pointer to the capacity of the output buffer.
+ */
+void processtype(char *formula, short *intArr, char **strArr, char strCount, char *flag, char **out, size_t *outLen, size_t *outCapacity);
+
+/**
+ * @brief Tokenizes a raw formula against the element names and evaluates it with processtype().
+ * 
+ * @param str          The raw formula as read from the input.
+ * @param intArr       Array of short integers representing atomic data.
+ * @param strArr       Array of strings with element names.
+ * @param strcapacity  The count of strings in strArr.
+ * @param flag         Pointer to a flag determining specific processing options.
+ * @param out          Pointer to the output buffer the result line is appended to.
+ * @param outLen       Pointer to the current length of the output buffer.
+ * @param outCapacity  Pointer to the capacity of the output buffer.
  */
-void processtype(char *formula, short *intArr, char **strArr, char strCount, char *flag, char *outputFile);
+void evaluateformula(char *str, short *intArr, char **strArr, int strcapacity, char *flag, char **out, size_t *outLen, size_t *outCapacity);
 
 /**
  * @brief Calculates the number of protons for a given element or compound.
@@ -38,6 +59,19 @@ void processtype(char *formula, short *intArr, char **strArr, char strCount, cha
  */
 int calculateprotons(char *stringpegke, short *intArr, char **strArr, char strCount);
 
+/**
+ * @brief Adds the number of atoms of each element in a formula to a count array.
+ * 
+ * @param formula      The formula; it does not need to be null-terminated.
+ * @param len          The length of the formula.
+ * @param strArr       Array of strings with element names.
+ * @param strcapacity  The count of strings in strArr.
+ * @param counts       Array of strcapacity atom counts, indexed like strArr, to add to.
+ * 
+ * @return 0 on success, or 1 if the formula is malformed or names an unknown element.
+ */
+int countElements(const char *formula, int len, char **strArr, int strcapacity, int *counts);
+
 /**
  * @brief Checks if a given chemical formula is balanced.
  * 
@@ -69,9 +103,10 @@ void matchAndPush(char ***stringpegke, int *strCount, int *strCapacity, const ch
  * @param strArr       Triple pointer to an array of strings for storing element names.
  * @param strcapacity  The capacity of strArr.
  * @param flag         Pointer to a flag determining specific processing options.
- * @param inputFile    File pointer to the input file for processing.
- * @param outputFile   Pointer to a string representing the output file path.
+ * @param isotopes     Isotope data for -iso and -isoa (may be NULL otherwise).
+ * @param inputFile    Input stream for processing, plain or gzip-compressed (see stream.h).
+ * @param outputFile   Pointer to a string representing the output file path; a ".gz" name is written compressed.
  */
-void extentedtype(short **intArr, char ***strArr, int strcapacity, char *flag, FILE *inputFile, char *outputFile);
+void extentedtype(short **intArr, char ***strArr, int strcapacity, char *flag, IsotopeTable *isotopes, gzFile inputFile, char *outputFile);
 
 #endif
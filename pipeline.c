@@ -0,0 +1,671 @@
+/**
+ * @file pipeline.c
+ * @brief Implements the reader / evaluator / writer formula pipeline.
+ * @author agent
+ * @since 18/10/2026
+ * This source file includes the bounded ring buffers connecting the pipeline stages
+ * and the reader, evaluator and writer stages themselves.
+ */
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include "pipeline.h"
+#include "parser.h"
+#include "data.h"
+#include "balance.h"
+
+/**
+ * @brief A buffer of bytes passed between pipeline stages.
+ */
+typedef struct {
+    char *data;      /**< Block contents (not null-terminated). */
+    size_t len;      /**< Number of bytes in use. */
+    size_t capacity; /**< Allocated size of data. */
+    int last;        /**< 1 if a result block holds the last results of its input block. */
+    int overlong;    /**< 1 if an input block stands for a line longer than a block (-bal). */
+} Block;
+
+/**
+ * @brief Bounded lock-free ring buffer with a single producer and a single consumer.
+ *
+ * Pushing and popping are lock-free. A side that finds the ring full or empty polls it
+ * PIPELINE_SPIN_LIMIT times and then sleeps on cond; the other side only takes the lock
+ * to wake it when sleepers is non-zero.
+ */
+typedef struct {
+    Block *slots[PIPELINE_RING_SLOTS];        /**< Queued blocks. */
+    _Alignas(64) atomic_size_t head;          /**< Next slot to pop (owned by the consumer). */
+    _Alignas(64) atomic_size_t tail;          /**< Next slot to push (owned by the producer). */
+    _Alignas(64) atomic_int sleepers;         /**< Number of threads sleeping on cond. */
+    pthread_mutex_t lock;                     /**< Protects sleeping and waking. */
+    pthread_cond_t cond;                      /**< Signalled when head or tail moves. */
+} Ring;
+
+/**
+ * @brief Shared state of one pipeline run.
+ *
+ * Blocks are dealt to evaluators round-robin, and every evaluator has its own rings,
+ * so each ring keeps exactly one producer and one consumer and the writer can restore
+ * input order by visiting the evaluators in the same round-robin order.
+ */
+typedef struct {
+    gzFile input;                             /**< Input stream. */
+    gzFile output;                            /**< Output stream. */
+    short *intArr;                            /**< Atomic data. */
+    char **strArr;                            /**< Element names. */
+    int strcapacity;                          /**< Number of elements in strArr. */
+    char *flag;                               /**< Processing mode flag. */
+    IsotopeTable *isotopes;                   /**< Isotope data, or NULL if the mode needs none. */
+    int evaluators;                           /**< Number of evaluator threads. */
+    int lineRecords;                          /**< 1 if records are lines (-bal), 0 if whitespace-separated formulas. */
+    int isotopeMode;                          /**< 0, or 1 for fine (-iso) or 2 for aggregate (-isoa) patterns. */
+    long limit;                               /**< Input bytes left to read, or -1 for no limit. */
+    long counts[PIPELINE_MAX_EVALUATORS];     /**< Formulas evaluated by each evaluator, stored when it finishes. */
+    atomic_int failed;                        /**< Set when a stage hit an error. */
+    Ring inFull[PIPELINE_MAX_EVALUATORS];     /**< Reader -> evaluator, filled input blocks. */
+    Ring inFree[PIPELINE_MAX_EVALUATORS];     /**< Evaluator -> reader, consumed input blocks. */
+    Ring outFull[PIPELINE_MAX_EVALUATORS];    /**< Evaluator -> writer, filled result blocks. */
+    Ring outFree[PIPELINE_MAX_EVALUATORS];    /**< Writer -> evaluator, written result blocks. */
+} Pipeline;
+
+/**
+ * @brief Arguments of an evaluator thread.
+ */
+typedef struct {
+    Pipeline *pipeline; /**< The pipeline the evaluator belongs to. */
+    int index;          /**< Index of the evaluator's rings. */
+} EvaluatorArgs;
+
+/**
+ * @brief Initializes an empty ring.
+ *
+ * @param ring  The ring to initialize.
+ *
+ * @return 0 on success, or non-zero on failure.
+ */
+static int ringInit(Ring *ring) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->sleepers, 0);
+    if (pthread_mutex_init(&ring->lock, NULL) != 0) {
+        return 1;
+    }
+    if (pthread_cond_init(&ring->cond, NULL) != 0) {
+        pthread_mutex_destroy(&ring->lock);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Destroys a ring's lock and condition variable.
+ *
+ * @param ring  The ring to destroy.
+ */
+static void ringDestroy(Ring *ring) {
+    pthread_cond_destroy(&ring->cond);
+    pthread_mutex_destroy(&ring->lock);
+}
+
+/**
+ * @brief Waits until the head or tail of a ring differs from the given position.
+ *
+ * Polls PIPELINE_SPIN_LIMIT times, then sleeps. The sleeper count is raised before the
+ * position is checked again under the lock, and ringWake() checks the count after
+ * moving the position, so a wakeup cannot be lost.
+ *
+ * @param ring      The ring to wait on.
+ * @param position  The head or tail of the ring to watch.
+ * @param value     The value to wait for position to move away from.
+ */
+static void ringWait(Ring *ring, atomic_size_t *position, size_t value) {
+    for (int spins = 0; spins < PIPELINE_SPIN_LIMIT; spins++) {
+        if (atomic_load_explicit(position, memory_order_acquire) != value) {
+            return;
+        }
+    }
+    pthread_mutex_lock(&ring->lock);
+    atomic_fetch_add(&ring->sleepers, 1);
+    while (atomic_load(position) == value) {
+        pthread_cond_wait(&ring->cond, &ring->lock);
+    }
+    atomic_fetch_sub(&ring->sleepers, 1);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/**
+ * @brief Wakes the thread sleeping on a ring, if any, after its head or tail moved.
+ *
+ * @param ring  The ring whose head or tail moved.
+ */
+static void ringWake(Ring *ring) {
+    if (atomic_load(&ring->sleepers) > 0) {
+        pthread_mutex_lock(&ring->lock);
+        pthread_cond_broadcast(&ring->cond);
+        pthread_mutex_unlock(&ring->lock);
+    }
+}
+
+/**
+ * @brief Pushes a block onto a ring, waiting while the ring is full.
+ *
+ * @param ring   The ring to push onto.
+ * @param block  The block to push (NULL marks the end of the stream).
+ */
+static void ringPush(Ring *ring, Block *block) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    while (tail - head == PIPELINE_RING_SLOTS) {
+        ringWait(ring, &ring->head, head);
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    }
+    ring->slots[tail % PIPELINE_RING_SLOTS] = block;
+    atomic_store(&ring->tail, tail + 1);
+    ringWake(ring);
+}
+
+/**
+ * @brief Pops a block from a ring, waiting while the ring is empty.
+ *
+ * @param ring  The ring to pop from.
+ *
+ * @return The popped block, or NULL at the end of the stream.
+ */
+static Block *ringPop(Ring *ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while (atomic_load_explicit(&ring->tail, memory_order_acquire) == head) {
+        ringWait(ring, &ring->tail, head);
+    }
+    Block *block = ring->slots[head % PIPELINE_RING_SLOTS];
+    atomic_store(&ring->head, head + 1);
+    ringWake(ring);
+    return block;
+}
+
+/**
+ * @brief Allocates a block with the given capacity.
+ *
+ * @param capacity  Number of bytes to allocate.
+ *
+ * @return The new block, or NULL on allocation failure.
+ */
+static Block *newBlock(size_t capacity) {
+    Block *block = (Block *)malloc(sizeof(Block));
+    if (block == NULL) {
+        return NULL;
+    }
+    block->data = (char *)malloc(capacity * sizeof(char));
+    if (block->data == NULL) {
+        free(block);
+        return NULL;
+    }
+    block->len = 0;
+    block->capacity = capacity;
+    block->last = 1;
+    block->overlong = 0;
+    return block;
+}
+
+/**
+ * @brief Frees a block and its contents.
+ *
+ * @param block  The block to free.
+ */
+static void freeBlock(Block *block) {
+    free(block->data);
+    free(block);
+}
+
+/**
+ * @brief Checks whether a character ends a record.
+ *
+ * @param p  The pipeline.
+ * @param c  The character.
+ *
+ * @return Non-zero if c separates records, zero otherwise.
+ */
+static int isRecordEnd(Pipeline *p, char c) {
+    return p->lineRecords ? c == '\n' : isspace((unsigned char)c);
+}
+
+/**
+ * @brief Reads past the end of the current line, keeping what follows it in the carry.
+ *
+ * Used in line mode when a line does not fit in a block, so the line is never split
+ * into several records.
+ *
+ * @param p         The pipeline.
+ * @param carry     Buffer of PIPELINE_BLOCK_SIZE bytes receiving the bytes after the line.
+ * @param carryLen  Receives the number of bytes kept in carry.
+ *
+ * @return 1 if the input ended before the end of the line, 0 otherwise.
+ */
+static int skipLine(Pipeline *p, char *carry, int *carryLen) {
+    *carryLen = 0;
+    for (;;) {
+        int want = PIPELINE_BLOCK_SIZE;
+        if (p->limit >= 0 && p->limit < want) {
+            want = (int)p->limit;
+        }
+        int got = gzread(p->input, carry, want);
+        if (got < 0) {
+            int errnum;
+            fprintf(stderr, "Error reading input: %s\n", gzerror(p->input, &errnum));
+            p->failed = 1;
+            return 1;
+        }
+        if (p->limit >= 0) {
+            p->limit -= got;
+        }
+        char *newline = (char *)memchr(carry, '\n', got);
+        if (newline != NULL) {
+            *carryLen = got - (int)(newline + 1 - carry);
+            memmove(carry, newline + 1, *carryLen);
+            return 0;
+        }
+        if (got < want || p->limit == 0) {
+            return 1;
+        }
+    }
+}
+
+/**
+ * @brief Reader stage: fills input blocks, cutting them between records so no record is split.
+ *
+ * @param arg  The pipeline.
+ *
+ * @return NULL.
+ */
+static void *readerThread(void *arg) {
+    Pipeline *p = (Pipeline *)arg;
+    char *carry = (char *)malloc(PIPELINE_BLOCK_SIZE * sizeof(char));
+    int carryLen = 0;
+    if (carry == NULL) {
+        perror("Error allocating memory\n");
+        p->failed = 1;
+    }
+
+    for (long i = 0; ; i++) {
+        Block *block = ringPop(&p->inFree[i % p->evaluators]);
+        int eof = 1;
+        block->len = 0;
+        block->overlong = 0;
+        if (carry != NULL) {
+            memcpy(block->data, carry, carryLen);
+            int want = PIPELINE_BLOCK_SIZE - carryLen;
+            if (p->limit >= 0 && p->limit < want) {
+                want = (int)p->limit;
+            }
+            int got = gzread(p->input, block->data + carryLen, want);
+            if (got < 0) {
+                int errnum;
+                fprintf(stderr, "Error reading input: %s\n", gzerror(p->input, &errnum));
+                p->failed = 1;
+                got = 0;
+            }
+            block->len = carryLen + got;
+            if (p->limit >= 0) {
+                p->limit -= got;
+            }
+            eof = got < want || p->limit == 0;
+        }
+
+        // Keep a trailing partial record for the next block
+        int cut = block->len;
+        if (!eof) {
+            while (cut > 0 && !isRecordEnd(p, block->data[cut - 1])) {
+                cut--;
+            }
+        }
+        if (cut == 0 && p->lineRecords && !eof) {
+            // The whole block is the start of one line: replace the line by a marker
+            block->len = 0;
+            block->overlong = 1;
+            eof = skipLine(p, carry, &carryLen);
+        } else {
+            if (cut == 0) {
+                cut = block->len;
+            }
+            carryLen = block->len - cut;
+            if (carryLen > 0) {
+                memcpy(carry, block->data + cut, carryLen);
+            }
+            block->len = cut;
+        }
+
+        ringPush(&p->inFull[i % p->evaluators], block);
+        if (eof) {
+            break;
+        }
+    }
+
+    for (int e = 0; e < p->evaluators; e++) {
+        ringPush(&p->inFull[e], NULL);
+    }
+    free(carry);
+    return NULL;
+}
+
+/**
+ * @brief Hands a result block to the writer once it holds PIPELINE_OUTPUT_LIMIT bytes.
+ *
+ * Called between records, so result blocks are only ever split at line boundaries and
+ * the memory held by one input block's results stays bounded.
+ *
+ * @param p    The pipeline.
+ * @param e    Index of the evaluator.
+ * @param out  The result block being filled.
+ *
+ * @return The block to keep filling: out itself, or a fresh block from the writer.
+ */
+static Block *flushOutput(Pipeline *p, int e, Block *out) {
+    if (out->len < PIPELINE_OUTPUT_LIMIT) {
+        return out;
+    }
+    out->last = 0;
+    ringPush(&p->outFull[e], out);
+    out = ringPop(&p->outFree[e]);
+    out->len = 0;
+    return out;
+}
+
+/**
+ * @brief Evaluates every whitespace-separated formula of an input block.
+ *
+ * @param p        The pipeline.
+ * @param e        Index of the evaluator.
+ * @param in       The input block.
+ * @param out      The block receiving the result lines; replaced when it fills up.
+ * @param scratch  Isotopic pattern scratch of the evaluator (NULL unless in isotope mode).
+ * @param count    The evaluator's formula count, incremented for every formula.
+ */
+static void evaluateFormulas(Pipeline *p, int e, Block *in, Block **out, IsotopeScratch *scratch, long *count) {
+    char str[100];
+    size_t i = 0;
+    while (i < in->len) {
+        while (i < in->len && isspace((unsigned char)in->data[i])) {
+            i++;
+        }
+        int len = 0;
+        while (i < in->len && !isspace((unsigned char)in->data[i])) {
+            if (len < (int)sizeof(str) - 1) {
+                str[len++] = in->data[i];
+            }
+            i++;
+        }
+        if (len > 0) {
+            str[len] = '\0';
+            (*count)++;
+            Block *o = *out;
+            if (p->isotopeMode) {
+                isotopepattern(str, p->strArr, p->isotopes, p->isotopeMode == 2, scratch, &o->data, &o->len, &o->capacity);
+            } else {
+                evaluateformula(str, p->intArr, p->strArr, p->strcapacity, p->flag, &o->data, &o->len, &o->capacity);
+            }
+            *out = flushOutput(p, e, o);
+        }
+    }
+}
+
+/**
+ * @brief Balances every line of an input block as a reaction.
+ *
+ * Every input line gives exactly one result line, so results line up with the input;
+ * a blank line gives a blank result line, and a line too long for a block gives an
+ * "Error: line too long" line. Lines are null-terminated in place, so no record is
+ * copied.
+ *
+ * @param p        The pipeline.
+ * @param e        Index of the evaluator.
+ * @param in       The input block.
+ * @param out      The block receiving the result lines; replaced when it fills up.
+ * @param scratch  Balancing scratch of the evaluator.
+ * @param count    The evaluator's result line count, incremented for every line.
+ */
+static void evaluateReactions(Pipeline *p, int e, Block *in, Block **out, BalanceScratch *scratch, long *count) {
+    if (in->overlong) {
+        (*count)++;
+        pushChars(&(*out)->data, &(*out)->len, &(*out)->capacity, "Error: line too long\n");
+        *out = flushOutput(p, e, *out);
+        return;
+    }
+    size_t i = 0;
+    while (i < in->len) {
+        size_t start = i;
+        while (i < in->len && in->data[i] != '\n') {
+            i++;
+        }
+        size_t end = i++;
+        if (end > start && in->data[end - 1] == '\r') {
+            end--;
+        }
+        in->data[end] = '\0';
+
+        size_t k = start;
+        while (k < end && isspace((unsigned char)in->data[k])) {
+            k++;
+        }
+        (*count)++;
+        Block *o = *out;
+        if (k < end) {
+            balancereaction(&in->data[start], p->strArr, p->strcapacity, scratch, &o->data, &o->len, &o->capacity);
+        } else {
+            pushChars(&o->data, &o->len, &o->capacity, "\n");
+        }
+        *out = flushOutput(p, e, o);
+    }
+}
+
+/**
+ * @brief Evaluator stage: turns each input block into one or more blocks of result lines.
+ *
+ * @param arg  The evaluator's arguments.
+ *
+ * @return NULL.
+ */
+static void *evaluatorThread(void *arg) {
+    EvaluatorArgs *args = (EvaluatorArgs *)arg;
+    Pipeline *p = args->pipeline;
+    int e = args->index;
+    BalanceScratch *scratch = NULL;
+    IsotopeScratch *isotopeScratch = NULL;
+
+    if (p->lineRecords) {
+        scratch = newBalanceScratch(p->strcapacity);
+    } else if (p->isotopeMode) {
+        isotopeScratch = newIsotopeScratch(p->strcapacity);
+    }
+    if ((p->lineRecords && scratch == NULL) || (p->isotopeMode && isotopeScratch == NULL)) {
+        perror("Error allocating memory\n");
+        exit(1);
+    }
+
+    // Counted locally: counts[] of neighbouring evaluators share cache lines
+    long count = 0;
+    Block *in;
+    while ((in = ringPop(&p->inFull[e])) != NULL) {
+        Block *out = ringPop(&p->outFree[e]);
+        out->len = 0;
+
+        if (p->lineRecords) {
+            evaluateReactions(p, e, in, &out, scratch, &count);
+        } else {
+            evaluateFormulas(p, e, in, &out, isotopeScratch, &count);
+        }
+
+        ringPush(&p->inFree[e], in);
+        out->last = 1;
+        ringPush(&p->outFull[e], out);
+    }
+    p->counts[e] = count;
+    ringPush(&p->outFull[e], NULL);
+    freeBalanceScratch(scratch);
+    freeIsotopeScratch(isotopeScratch);
+    return NULL;
+}
+
+/**
+ * @brief Writes the contents of a result block to the output stream.
+ *
+ * @param output  The output stream.
+ * @param block   The block to write.
+ *
+ * @return 0 on success, or 1 on a write error.
+ */
+static int writeBlock(gzFile output, Block *block) {
+    size_t done = 0;
+    while (done < block->len) {
+        size_t chunk = block->len - done;
+        if (chunk > PIPELINE_OUTPUT_LIMIT) {
+            chunk = PIPELINE_OUTPUT_LIMIT;
+        }
+        if (gzwrite(output, block->data + done, (unsigned)chunk) != (int)chunk) {
+            int errnum;
+            fprintf(stderr, "Error writing output: %s\n", gzerror(output, &errnum));
+            return 1;
+        }
+        done += chunk;
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns the number of evaluator threads to use by default.
+ *
+ * @return The number of online processors, clamped to [1, PIPELINE_MAX_EVALUATORS].
+ */
+int defaultEvaluators(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) {
+        return 1;
+    }
+    if (cpus > PIPELINE_MAX_EVALUATORS) {
+        return PIPELINE_MAX_EVALUATORS;
+    }
+    return (int)cpus;
+}
+
+/**
+ * @brief Evaluates every formula of an input stream and writes the results in input order.
+ *
+ * The calling thread acts as the writer stage.
+ *
+ * @param input        Stream to read formulas from (see stream.h).
+ * @param output       Stream to write results to (see stream.h).
+ * @param intArr       Array of atomic data.
+ * @param strArr       Array of element names.
+ * @param strcapacity  Number of elements in strArr.
+ * @param flag         Processing mode flag (-pn, -ext, -bal, -iso or -isoa).
+ * @param isotopes     Isotope data for -iso and -isoa (may be NULL otherwise).
+ * @param evaluators   Number of evaluator threads.
+ * @param limit        Maximum number of input bytes to read, or -1 to read to the end.
+ * @param count        Receives the number of formulas evaluated (may be NULL).
+ *
+ * @return 0 on success, or 1 on failure (memory, thread or write error).
+ */
+int runPipeline(gzFile input, gzFile output, short *intArr, char **strArr, int strcapacity, char *flag, IsotopeTable *isotopes, int evaluators, long limit, long *count) {
+    if (evaluators < 1) {
+        evaluators = 1;
+    } else if (evaluators > PIPELINE_MAX_EVALUATORS) {
+        evaluators = PIPELINE_MAX_EVALUATORS;
+    }
+
+    Pipeline *p = (Pipeline *)aligned_alloc(_Alignof(Pipeline), sizeof(Pipeline));
+    EvaluatorArgs args[PIPELINE_MAX_EVALUATORS];
+    pthread_t threads[PIPELINE_MAX_EVALUATORS];
+    pthread_t reader;
+    if (p == NULL) {
+        perror("Error allocating memory\n");
+        return 1;
+    }
+    memset(p, 0, sizeof(Pipeline));
+    p->input = input;
+    p->output = output;
+    p->intArr = intArr;
+    p->strArr = strArr;
+    p->strcapacity = strcapacity;
+    p->flag = flag;
+    p->isotopes = isotopes;
+    p->evaluators = evaluators;
+    p->limit = limit;
+    p->lineRecords = strcmp(flag, "-bal") == 0;
+    p->isotopeMode = strcmp(flag, "-iso") == 0 ? 1 : strcmp(flag, "-isoa") == 0 ? 2 : 0;
+
+    for (int e = 0; e < evaluators; e++) {
+        if (ringInit(&p->inFull[e]) != 0 || ringInit(&p->inFree[e]) != 0 || ringInit(&p->outFull[e]) != 0 || ringInit(&p->outFree[e]) != 0) {
+            perror("Error initializing ring");
+            exit(1);
+        }
+    }
+
+    // Every ring starts with its full pool of free blocks
+    for (int e = 0; e < evaluators; e++) {
+        for (int k = 0; k < PIPELINE_RING_SLOTS; k++) {
+            Block *in = newBlock(PIPELINE_BLOCK_SIZE + 1);
+            Block *out = newBlock(2 * PIPELINE_OUTPUT_LIMIT);
+            if (in == NULL || out == NULL) {
+                perror("Error allocating memory\n");
+                exit(1);
+            }
+            ringPush(&p->inFree[e], in);
+            ringPush(&p->outFree[e], out);
+        }
+    }
+
+    if (pthread_create(&reader, NULL, readerThread, p) != 0) {
+        perror("Error creating reader thread");
+        exit(1);
+    }
+    for (int e = 0; e < evaluators; e++) {
+        args[e].pipeline = p;
+        args[e].index = e;
+        if (pthread_create(&threads[e], NULL, evaluatorThread, &args[e]) != 0) {
+            perror("Error creating evaluator thread");
+            exit(1);
+        }
+    }
+
+    // Writer stage: drain each evaluator up to the last block of its input block, in turn
+    Block *out;
+    long i = 0;
+    while ((out = ringPop(&p->outFull[i % evaluators])) != NULL) {
+        int last = out->last;
+        if (writeBlock(output, out) != 0) {
+            p->failed = 1;
+        }
+        ringPush(&p->outFree[i % evaluators], out);
+        if (last) {
+            i++;
+        }
+    }
+
+    pthread_join(reader, NULL);
+    for (int e = 0; e < evaluators; e++) {
+        pthread_join(threads[e], NULL);
+    }
+
+    // Every block is back in a free ring once all stages have finished
+    for (int e = 0; e < evaluators; e++) {
+        for (int k = 0; k < PIPELINE_RING_SLOTS; k++) {
+            freeBlock(ringPop(&p->inFree[e]));
+            freeBlock(ringPop(&p->outFree[e]));
+        }
+        ringDestroy(&p->inFull[e]);
+        ringDestroy(&p->inFree[e]);
+        ringDestroy(&p->outFull[e]);
+        ringDestroy(&p->outFree[e]);
+    }
+
+    if (count != NULL) {
+        *count = 0;
+        for (int e = 0; e < evaluators; e++) {
+            *count += p->counts[e];
+        }
+    }
+    int failed = p->failed;
+    free(p);
+    return failed;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file pipeline.h
+ * @brief Header file for the reader / evaluator / writer formula pipeline.
+ * @author agent
+ * @since 18/10/2026
+ * This header file declares the staged pipeline that overlaps reading formulas,
+ * evaluating them and writing the results.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <zlib.h>
+#include "isotope.h"
+
+/** Number of input bytes handed to an evaluator at a time. */
+#define PIPELINE_BLOCK_SIZE 65536
+
+/** Number of result bytes after which an evaluator hands a result block to the writer. */
+#define PIPELINE_OUTPUT_LIMIT (4 * PIPELINE_BLOCK_SIZE)
+
+/** Number of blocks in flight between two stages (2 = double buffering). */
+#define PIPELINE_RING_SLOTS 2
+
+/** Number of times a stage polls a ring before it sleeps until the ring changes. */
+#define PIPELINE_SPIN_LIMIT 64
+
+/** Upper bound on the number of evaluator threads. */
+#define PIPELINE_MAX_EVALUATORS 16
+
+/**
+ * @brief Returns the number of evaluator threads to use by default.
+ *
+ * @return The number of online processors, clamped to [1, PIPELINE_MAX_EVALUATORS].
+ */
+int defaultEvaluators(void);
+
+/**
+ * @brief Evaluates every formula of an input stream and writes the results in input order.
+ *
+ * With the -bal flag every line is a reaction to balance (see balance.h) instead of a
+ * whitespace-separated formula. With -iso and -isoa the fine or aggregate isotopic
+ * pattern of every formula is computed (see isotope.h).
+ *
+ * A reader thread fills large input blocks, evaluator threads turn each block into
+ * blocks of result lines, and the calling thread writes the result blocks. Stages are
+ * connected by bounded single-producer / single-consumer ring buffers, so a fast
+ * stage waits for a slow one instead of buffering without limit; a stage that has
+ * waited for more than a short spin sleeps instead of burning CPU.
+ *
+ * @param input        Stream to read formulas from (see stream.h).
+ * @param output       Stream to write results to (see stream.h).
+ * @param intArr       Array of atomic data.
+ * @param strArr       Array of element names.
+ * @param strcapacity  Number of elements in strArr.
+ * @param flag         Processing mode flag (-pn, -ext, -bal, -iso or -isoa).
+ * @param isotopes     Isotope data for -iso and -isoa (may be NULL otherwise).
+ * @param evaluators   Number of evaluator threads.
+ * @param limit        Maximum number of input bytes to read, or -1 to read to the end.
+ * @param count        Receives the number of formulas evaluated (may be NULL).
+ *
+ * @return 0 on success, or 1 on failure (memory, thread or write error).
+ */
+int runPipeline(gzFile input, gzFile output, short *intArr, char **strArr, int strcapacity, char *flag, IsotopeTable *isotopes, int evaluators, long limit, long *count);
+
+#endif
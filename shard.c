@@ -0,0 +1,273 @@
+/**
+ * @file shard.c
+ * @brief Implements sharded processing and merging of shard results.
+ * @author agent
+ * @since 18/10/2026
+ * This source file includes implementations for splitting an input file into line-aligned
+ * byte ranges, evaluating one range, and merging the per-shard results in order.
+ */
+
+#include <string.h>
+#include <sys/stat.h>
+#include "shard.h"
+#include "pipeline.h"
+#include "stream.h"
+
+/**
+ * @brief Header of a shard result file.
+ */
+typedef struct {
+    char *path;        /**< Path to the shard result file. */
+    int k;             /**< Shard number, from 1 to n. */
+    int n;             /**< Number of shards. */
+    char flag[16];     /**< Processing mode flag the shard was evaluated with. */
+    double threshold;  /**< Isotope peak threshold the shard was evaluated with. */
+    long size;         /**< Size of the whole input in bytes. */
+    long start;        /**< First input byte of the shard. */
+    long end;          /**< One past the last input byte of the shard. */
+} ShardInfo;
+
+/**
+ * @brief Moves an input offset forward to the start of the next line.
+ *
+ * @param input   Uncompressed input stream.
+ * @param offset  Byte offset to align.
+ * @param size    Size of the input in bytes.
+ *
+ * @return The offset of the first line starting at or after offset, or size if there is none.
+ */
+static long alignToLine(gzFile input, long offset, long size) {
+    if (offset <= 0) {
+        return 0;
+    }
+    if (offset >= size || gzseek(input, offset - 1, SEEK_SET) < 0) {
+        return size;
+    }
+    int c;
+    while ((c = gzgetc(input)) != -1 && c != '\n') {
+    }
+    return c == -1 ? size : (long)gztell(input);
+}
+
+/**
+ * @brief Evaluates the formulas in shard k of n of an input file into a shard result file.
+ *
+ * @param intArr       Array of atomic data.
+ * @param strArr       Array of element names.
+ * @param strcapacity  Number of elements in strArr.
+ * @param flag         Processing mode flag (-pn, -ext, -bal, -iso or -isoa).
+ * @param isotopes     Isotope data for -iso and -isoa (may be NULL otherwise).
+ * @param input        Input stream; must be uncompressed so that it can be seeked.
+ * @param inputFile    Path to the input file.
+ * @param outputFile   Path to the shard result file (overwritten).
+ * @param k            Shard number, from 1 to n.
+ * @param n            Number of shards.
+ *
+ * @return 0 on success, or 1 on failure.
+ */
+int runShard(short *intArr, char **strArr, int strcapacity, char *flag, IsotopeTable *isotopes, gzFile input, char *inputFile, char *outputFile, int k, int n) {
+    struct stat st;
+    if (n < 1 || k < 1 || k > n) {
+        fprintf(stderr, "Invalid shard %d/%d\n", k, n);
+        return 1;
+    }
+    if (!gzdirect(input)) {
+        fprintf(stderr, "Shard mode needs an uncompressed input file: %s\n", inputFile);
+        return 1;
+    }
+    if (stat(inputFile, &st) != 0) {
+        perror("File error");
+        return 1;
+    }
+
+    long size = (long)st.st_size;
+    long start = alignToLine(input, (long)((k - 1) * (double)size / n), size);
+    long end = alignToLine(input, (long)(k * (double)size / n), size);
+    if (k == n) {
+        end = size;
+    }
+    if (gzseek(input, start, SEEK_SET) < 0) {
+        perror("Error seeking input");
+        return 1;
+    }
+
+    gzFile output = openOutput(outputFile, "w");
+    if (output == NULL) {
+        perror("Unable to open file");
+        return 1;
+    }
+    double threshold = isotopes != NULL ? isotopes->threshold : ISOTOPE_DEFAULT_THRESHOLD;
+    gzprintf(output, "#shard %d/%d %s %.17g %ld %ld %ld\n", k, n, flag, threshold, size, start, end);
+
+    long count = 0;
+    if (runPipeline(input, output, intArr, strArr, strcapacity, flag, isotopes, defaultEvaluators(), end - start, &count) != 0) {
+        return 1;
+    }
+    gzprintf(output, "#end %ld\n", count);
+    gzclose(input);
+    if (gzclose(output) != Z_OK) {
+        perror("Error closing output file");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads the header of a shard result file.
+ *
+ * @param path  Path to the shard result file.
+ * @param info  Receives the header fields.
+ *
+ * @return 0 on success, or 1 if the file cannot be read or has no shard header.
+ */
+static int readShardInfo(char *path, ShardInfo *info) {
+    char line[128];
+    gzFile in = openInput(path);
+    if (in == NULL) {
+        perror("File error");
+        return 1;
+    }
+    info->path = path;
+    int ok = gzgets(in, line, sizeof(line)) != NULL
+             && sscanf(line, "#shard %d/%d %15s %lf %ld %ld %ld", &info->k, &info->n, info->flag, &info->threshold, &info->size, &info->start, &info->end) == 7;
+    gzclose(in);
+    if (!ok) {
+        fprintf(stderr, "Not a shard result file: %s\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Orders shard headers by shard number.
+ *
+ * @param a  First ShardInfo.
+ * @param b  Second ShardInfo.
+ *
+ * @return Negative, zero or positive as for qsort().
+ */
+static int compareShards(const void *a, const void *b) {
+    return ((const ShardInfo *)a)->k - ((const ShardInfo *)b)->k;
+}
+
+/**
+ * @brief Appends the result lines of one shard to the output and checks its trailer.
+ *
+ * @param info    Header of the shard.
+ * @param output  Output stream.
+ * @param lines   Receives the number of result lines copied.
+ *
+ * @return 0 on success, or 1 on a read, write or trailer error.
+ */
+static int copyShard(ShardInfo *info, gzFile output, long *lines) {
+    char *buf = (char *)malloc(PIPELINE_BLOCK_SIZE * sizeof(char));
+    gzFile in = openInput(info->path);
+    if (buf == NULL || in == NULL) {
+        perror("Error opening shard");
+        free(buf);
+        return 1;
+    }
+
+    long expected = -1;
+    int lineStart = 1;
+    *lines = 0;
+    gzgets(in, buf, PIPELINE_BLOCK_SIZE); // header
+    while (gzgets(in, buf, PIPELINE_BLOCK_SIZE) != NULL) {
+        int len = strlen(buf);
+        if (lineStart && buf[0] == '#') {
+            if (sscanf(buf, "#end %ld", &expected) != 1) {
+                expected = -1;
+            }
+            break;
+        }
+        if (gzwrite(output, buf, len) != len) {
+            expected = -2;
+            break;
+        }
+        lineStart = len > 0 && buf[len - 1] == '\n';
+        if (lineStart) {
+            (*lines)++;
+        }
+    }
+    gzclose(in);
+    free(buf);
+
+    if (expected == -2) {
+        fprintf(stderr, "Error writing output\n");
+        return 1;
+    }
+    if (expected != *lines) {
+        fprintf(stderr, "Shard %d/%d in %s is truncated or corrupt\n", info->k, info->n, info->path);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Merges shard result files into the output a single serial run would have produced.
+ *
+ * Shard headers are validated before anything is written: every shard must come from
+ * the same mode, threshold and input size, and the byte ranges must cover the input
+ * exactly.
+ * Trailers are checked while the result lines are copied, so a damaged shard is
+ * reported after the shards before it.
+ *
+ * @param outputFile   Path to the output file (appended to, like extentedtype()).
+ * @param shardFiles   Paths to the shard result files.
+ * @param shardCount   Number of shard result files.
+ *
+ * @return 0 on success, or 1 on failure.
+ */
+int mergeShards(char *outputFile, char **shardFiles, int shardCount) {
+    ShardInfo *shards = (ShardInfo *)malloc(shardCount * sizeof(ShardInfo));
+    if (shards == NULL) {
+        perror("Error allocating memory\n");
+        return 1;
+    }
+    for (int i = 0; i < shardCount; i++) {
+        if (readShardInfo(shardFiles[i], &shards[i]) != 0) {
+            free(shards);
+            return 1;
+        }
+    }
+    qsort(shards, shardCount, sizeof(ShardInfo), compareShards);
+
+    for (int i = 0; i < shardCount; i++) {
+        long expectedStart = i == 0 ? 0 : shards[i - 1].end;
+        if (shards[i].n != shardCount || shards[i].k != i + 1 || shards[i].start != expectedStart
+            || strcmp(shards[i].flag, shards[0].flag) != 0 || shards[i].threshold != shards[0].threshold
+            || shards[i].size != shards[0].size
+            || (i == shardCount - 1 && shards[i].end != shards[i].size)) {
+            fprintf(stderr, "Shard set is incomplete or inconsistent at %s\n", shards[i].path);
+            free(shards);
+            return 1;
+        }
+    }
+
+    gzFile output = openOutput(outputFile, "a");
+    if (output == NULL) {
+        perror("Unable to open file");
+        free(shards);
+        return 1;
+    }
+    long firstLine = 1;
+    int failed = 0;
+    for (int i = 0; i < shardCount && !failed; i++) {
+        long lines = 0;
+        failed = copyShard(&shards[i], output, &lines);
+        if (!failed) {
+            if (lines == 0) {
+                printf("Shard %d/%d: no lines\n", shards[i].k, shards[i].n);
+            } else {
+                printf("Shard %d/%d: lines %ld-%ld\n", shards[i].k, shards[i].n, firstLine, firstLine + lines - 1);
+            }
+            firstLine += lines;
+        }
+    }
+    if (gzclose(output) != Z_OK) {
+        perror("Error closing output file");
+        failed = 1;
+    }
+    free(shards);
+    return failed;
+}
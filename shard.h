@@ -0,0 +1,59 @@
+/**
+ * @file shard.h
+ * @brief Header file for sharded processing and merging of shard results.
+ * @author agent
+ * @since 18/10/2026
+ * This header file declares functions for processing one byte range of a large input
+ * as an independent job and for stitching the shard results back together.
+ */
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <zlib.h>
+#include "isotope.h"
+
+/**
+ * @brief Evaluates the formulas in shard k of n of an input file into a shard result file.
+ *
+ * The input is split into n byte ranges of roughly equal size whose boundaries are moved
+ * forward to the next line start. The shard file begins with a
+ * "#shard k/n flag threshold size start end" header holding the mode, the isotope peak
+ * threshold, the input size and the byte range, and ends with an "#end lines" trailer
+ * holding the number of result lines, which mergeShards() uses to validate and number
+ * the shards.
+ *
+ * @param intArr       Array of atomic data.
+ * @param strArr       Array of element names.
+ * @param strcapacity  Number of elements in strArr.
+ * @param flag         Processing mode flag (-pn, -ext, -bal, -iso or -isoa).
+ * @param isotopes     Isotope data for -iso and -isoa (may be NULL otherwise).
+ * @param input        Input stream; must be uncompressed so that it can be seeked.
+ * @param inputFile    Path to the input file.
+ * @param outputFile   Path to the shard result file (overwritten).
+ * @param k            Shard number, from 1 to n.
+ * @param n            Number of shards.
+ *
+ * @return 0 on success, or 1 on failure.
+ */
+int runShard(short *intArr, char **strArr, int strcapacity, char *flag, IsotopeTable *isotopes, gzFile input, char *inputFile, char *outputFile, int k, int n);
+
+/**
+ * @brief Merges shard result files into the output a single serial run would have produced.
+ *
+ * Shards may be given in any order. They are sorted by shard number and checked for a
+ * common mode, threshold and input size and a complete, contiguous set of byte ranges
+ * before the result lines are appended to the output file; a shard whose trailer does
+ * not match its line count is an error. The global line range of each shard is printed.
+ *
+ * @param outputFile   Path to the output file (appended to, like extentedtype()).
+ * @param shardFiles   Paths to the shard result files.
+ * @param shardCount   Number of shard result files.
+ *
+ * @return 0 on success, or 1 on failure.
+ */
+int mergeShards(char *outputFile, char **shardFiles, int shardCount);
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * @file stream.c
+ * @brief Implements plain and gzip-compressed file streams.
+ * @author agent
+ * @since 18/10/2026
+ * This source file includes implementations for opening formula input and result output
+ * streams through zlib, which reads plain and gzip files alike.
+ */
+
+#include <ctype.h>
+#include <string.h>
+#include "stream.h"
+
+/**
+ * @brief Opens an input file, decompressing it on the fly if it is gzip-compressed.
+ *
+ * zlib recognizes the gzip header itself and reads any other file unchanged.
+ *
+ * @param path  Path to the input file.
+ *
+ * @return The opened stream, or NULL on failure.
+ */
+gzFile openInput(const char *path) {
+    gzFile in = gzopen(path, "rb");
+    if (in == NULL) {
+        return NULL;
+    }
+    gzbuffer(in, STREAM_BUFFER_SIZE);
+    return in;
+}
+
+/**
+ * @brief Opens an output file, compressing it on the fly if its name ends in ".gz".
+ *
+ * Appending to a compressed file adds a new gzip member, which gzip readers treat as
+ * a continuation of the same file. Other files are written without compression.
+ *
+ * @param path  Path to the output file.
+ * @param mode  "a" to append to the file or "w" to truncate it.
+ *
+ * @return The opened stream, or NULL on failure.
+ */
+gzFile openOutput(const char *path, const char *mode) {
+    char gzMode[4];
+    int len = strlen(path);
+    int compressed = len > 3 && strcmp(path + len - 3, ".gz") == 0;
+
+    snprintf(gzMode, sizeof(gzMode), "%cb%s", mode[0], compressed ? "" : "T");
+    gzFile out = gzopen(path, gzMode);
+    if (out == NULL) {
+        return NULL;
+    }
+    gzbuffer(out, STREAM_BUFFER_SIZE);
+    return out;
+}
+
+/**
+ * @brief Reads the next whitespace-separated token from a stream.
+ *
+ * @param in    The stream to read from.
+ * @param buf   Buffer receiving the token; longer tokens are truncated.
+ * @param size  Size of buf.
+ *
+ * @return 1 if a token was read, 0 at the end of the stream.
+ */
+int readToken(gzFile in, char *buf, int size) {
+    int c = gzgetc(in);
+    while (c != -1 && isspace(c)) {
+        c = gzgetc(in);
+    }
+    if (c == -1) {
+        return 0;
+    }
+
+    int len = 0;
+    while (c != -1 && !isspace(c)) {
+        if (len < size - 1) {
+            buf[len++] = c;
+        }
+        c = gzgetc(in);
+    }
+    buf[len] = '\0';
+    return 1;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file stream.h
+ * @brief Header file for plain and gzip-compressed file streams.
+ * @author agent
+ * @since 18/10/2026
+ * This header file declares functions for opening formula input and result output
+ * streams that transparently handle gzip compression.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <zlib.h>
+
+/** Size of the zlib buffers used for input and output streams. */
+#define STREAM_BUFFER_SIZE 262144
+
+/**
+ * @brief Opens an input file, decompressing it on the fly if it is gzip-compressed.
+ *
+ * @param path  Path to the input file.
+ *
+ * @return The opened stream, or NULL on failure.
+ */
+gzFile openInput(const char *path);
+
+/**
+ * @brief Opens an output file, compressing it on the fly if its name ends in ".gz".
+ *
+ * @param path  Path to the output file.
+ * @param mode  "a" to append to the file or "w" to truncate it.
+ *
+ * @return The opened stream, or NULL on failure.
+ */
+gzFile openOutput(const char *path, const char *mode);
+
+/**
+ * @brief Reads the next whitespace-separated token from a stream.
+ *
+ * @param in    The stream to read from.
+ * @param buf   Buffer receiving the token; longer tokens are truncated.
+ * @param size  Size of buf.
+ *
+ * @return 1 if a token was read, 0 at the end of the stream.
+ */
+int readToken(gzFile in, char *buf, int size);
+
+#endif